@@ -0,0 +1,179 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/*
+ * Many slow, I/O bound calls in flight. A blocking plugin holds an Executor
+ * worker for each call, an AsyncPlugin only while starting its I/O.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include <executor.h>
+#include <registry.h>
+
+namespace osquery {
+
+/// The simulated I/O latency of every call.
+const std::chrono::microseconds kIoLatency(500);
+
+/// A single thread standing in for an event loop, firing I/O completions.
+class SimulatedIo : private boost::noncopyable {
+ public:
+  static SimulatedIo& get() {
+    // Never destroyed, the detached thread waits on it until exit.
+    static auto io = new SimulatedIo();
+    return *io;
+  }
+
+  void after(std::chrono::microseconds delay, std::function<void()> ready) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.emplace(std::chrono::steady_clock::now() + delay,
+                     std::move(ready));
+    condition_.notify_one();
+  }
+
+ private:
+  SimulatedIo() : thread_([this]() { run(); }) {
+    thread_.detach();
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      if (pending_.empty()) {
+        condition_.wait(lock);
+        continue;
+      }
+
+      auto next = pending_.begin();
+      if (condition_.wait_until(lock, next->first) ==
+          std::cv_status::no_timeout) {
+        continue;
+      }
+
+      next = pending_.begin();
+      auto ready = std::move(next->second);
+      pending_.erase(next);
+      lock.unlock();
+      ready();
+      lock.lock();
+    }
+  }
+
+ private:
+  std::multimap<std::chrono::steady_clock::time_point, std::function<void()>>
+      pending_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::thread thread_;
+};
+
+class BlockingIoPlugin : public Plugin {
+ public:
+  Status call(const PluginRequest& request, PluginResponse& response) override {
+    std::this_thread::sleep_for(kIoLatency);
+    response.push_back({{"value", "1"}});
+    return Status(0, "OK");
+  }
+};
+
+class AsyncIoPlugin : public AsyncPlugin {
+ public:
+  void callAsync(const PluginRequest& request, PluginCompletion done) override {
+    SimulatedIo::get().after(kIoLatency, [done]() {
+      done(Status(0, "OK"), {{{"value", "1"}}});
+    });
+  }
+};
+
+/// Completes without I/O, the cost of the asynchronous call path alone.
+class InlineAsyncPlugin : public AsyncPlugin {
+ public:
+  void callAsync(const PluginRequest& request, PluginCompletion done) override {
+    done(Status(0, "OK"), PluginResponse());
+  }
+};
+
+static void ensureAsyncRegistries() {
+  static std::once_flag once;
+  std::call_once(once, []() {
+    auto blocking =
+        std::make_shared<RegistryType<BlockingIoPlugin>>("benchmark_blocking");
+    blocking->add("blocking", std::make_shared<BlockingIoPlugin>());
+    RegistryFactory::get().add("benchmark_blocking", blocking);
+
+    auto async = std::make_shared<RegistryType<AsyncPlugin>>("benchmark_async");
+    async->add("async", std::make_shared<AsyncIoPlugin>());
+    async->add("inline", std::make_shared<InlineAsyncPlugin>());
+    RegistryFactory::get().add("benchmark_async", async);
+  });
+}
+
+/// Keep state.range(0) calls in flight, then wait for all of them.
+static void runInFlight(benchmark::State& state,
+                        const std::string& registry,
+                        const std::string& item) {
+  ensureAsyncRegistries();
+  PluginRequest request = {{"action", "read"}};
+  std::vector<PluginCallFuture> calls(state.range(0));
+  while (state.KeepRunning()) {
+    for (auto& call : calls) {
+      call = RegistryFactory::callAsync(registry, item, request);
+    }
+    for (auto& call : calls) {
+      benchmark::DoNotOptimize(call.get());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["workers"] = Executor::get().size();
+}
+
+static void ASYNC_blocking_in_flight(benchmark::State& state) {
+  runInFlight(state, "benchmark_blocking", "blocking");
+}
+
+BENCHMARK(ASYNC_blocking_in_flight)->Arg(8)->Arg(64)->UseRealTime();
+
+static void ASYNC_plugin_in_flight(benchmark::State& state) {
+  runInFlight(state, "benchmark_async", "async");
+}
+
+BENCHMARK(ASYNC_plugin_in_flight)->Arg(8)->Arg(64)->UseRealTime();
+
+static void ASYNC_call_overhead(benchmark::State& state) {
+  ensureAsyncRegistries();
+  PluginRequest request = {{"action", "read"}};
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(
+        RegistryFactory::callAsync("benchmark_async", "inline", request).get());
+  }
+}
+
+BENCHMARK(ASYNC_call_overhead);
+
+/// The synchronous call of an AsyncPlugin, waiting for its completion.
+static void ASYNC_plugin_sync_call(benchmark::State& state) {
+  ensureAsyncRegistries();
+  PluginRequest request = {{"action", "read"}};
+  PluginResponse response;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(
+        RegistryFactory::call("benchmark_async", "inline", request, response));
+  }
+}
+
+BENCHMARK(ASYNC_plugin_sync_call);
+}
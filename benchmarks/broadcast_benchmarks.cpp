@@ -0,0 +1,168 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <mutex>
+
+#include <benchmark/benchmark.h>
+
+#include <broadcast.h>
+#include <registry.h>
+
+namespace osquery {
+
+/// Registries and plugins per registry in the broadcast benchmarks.
+const size_t kBroadcastRegistries = 8;
+const size_t kBroadcastPlugins = 100;
+
+class RoutePlugin : public Plugin {
+ public:
+  Status call(const PluginRequest& request, PluginResponse& response) override {
+    return Status(0, "OK");
+  }
+
+  /// Shaped like a table's route, a few columns of attach information.
+  PluginResponse routeInfo() const override {
+    PluginResponse info;
+    for (size_t i = 0; i < 4; i++) {
+      info.push_back({{"id", "column"},
+                      {"name", "column_" + std::to_string(i)},
+                      {"type", "TEXT"},
+                      {"op", "0"}});
+    }
+    return info;
+  }
+};
+
+static void addBroadcastRegistries() {
+  static std::once_flag once;
+  std::call_once(once, []() {
+    for (size_t i = 0; i < kBroadcastRegistries; i++) {
+      auto name = "broadcast_" + std::to_string(i);
+      auto registry = std::make_shared<RegistryType<RoutePlugin>>(name);
+      for (size_t j = 0; j < kBroadcastPlugins; j++) {
+        registry->add("route_" + std::to_string(j),
+                      std::make_shared<RoutePlugin>());
+      }
+      RegistryFactory::get().add(name, registry);
+    }
+  });
+}
+
+/// Change one route, as a single plugin registration would.
+static void changeOneRoute() {
+  auto registry = RegistryFactory::get().registry("broadcast_0");
+  registry->remove("route_changed");
+  registry->add("route_changed", std::make_shared<RoutePlugin>());
+}
+
+static void REGISTRY_broadcast_full(benchmark::State& state) {
+  addBroadcastRegistries();
+  size_t bytes = 0;
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    changeOneRoute();
+    state.ResumeTiming();
+
+    auto broadcast = RegistryFactory::get().getBroadcast();
+    benchmark::DoNotOptimize(broadcast);
+    state.PauseTiming();
+    bytes = 0;
+    for (const auto& registry : broadcast) {
+      RegistryBroadcastDelta delta;
+      delta[registry.first].added = registry.second;
+      bytes += encodeBroadcastDelta(0, delta).size();
+    }
+    state.ResumeTiming();
+  }
+  state.counters["bytes"] = static_cast<double>(bytes);
+}
+
+BENCHMARK(REGISTRY_broadcast_full);
+
+static void REGISTRY_broadcast_delta(benchmark::State& state) {
+  addBroadcastRegistries();
+  size_t generation = RegistryFactory::broadcastGeneration();
+  size_t bytes = 0;
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    changeOneRoute();
+    state.ResumeTiming();
+
+    size_t next = 0;
+    auto delta = RegistryFactory::get().getBroadcastDelta(generation, next);
+    auto encoded = encodeBroadcastDelta(next, delta);
+    generation = next;
+    bytes = encoded.size();
+    benchmark::DoNotOptimize(encoded);
+  }
+  state.counters["bytes"] = static_cast<double>(bytes);
+}
+
+BENCHMARK(REGISTRY_broadcast_delta);
+
+static void REGISTRY_broadcast_encoded(benchmark::State& state) {
+  addBroadcastRegistries();
+  size_t bytes = 0;
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    changeOneRoute();
+    state.ResumeTiming();
+
+    // Only the changed registry recomputes its routes.
+    size_t generation = 0;
+    auto encoded = encodeBroadcast(generation);
+    bytes = encoded.size();
+    benchmark::DoNotOptimize(encoded);
+  }
+  state.counters["bytes"] = static_cast<double>(bytes);
+}
+
+BENCHMARK(REGISTRY_broadcast_encoded);
+
+/// Extensions already registered while one extension restarts.
+const size_t kResidentExtensions = 50;
+
+static RegistryBroadcast makeExtensionBroadcast(size_t extension,
+                                                size_t routes) {
+  RegistryBroadcast broadcast;
+  auto& registry = broadcast["broadcast_0"];
+  for (size_t i = 0; i < routes; i++) {
+    registry["extension_" + std::to_string(extension) + "_" +
+             std::to_string(i)] = PluginResponse();
+  }
+  return broadcast;
+}
+
+static void REGISTRY_broadcast_churn(benchmark::State& state) {
+  addBroadcastRegistries();
+  auto& rf = RegistryFactory::get();
+  size_t routes = static_cast<size_t>(state.range(0));
+
+  // Distinct UUIDs per argument, the factory outlives each benchmark run.
+  RouteUUID base = routes * 1000;
+  for (size_t i = 1; i <= kResidentExtensions; i++) {
+    rf.addBroadcast(base + i, makeExtensionBroadcast(base + i, routes));
+  }
+
+  auto restarting = base + kResidentExtensions + 1;
+  auto broadcast = makeExtensionBroadcast(restarting, routes);
+  while (state.KeepRunning()) {
+    rf.addBroadcast(restarting, broadcast);
+    rf.removeBroadcast(restarting);
+  }
+  state.SetItemsProcessed(state.iterations() * routes);
+
+  for (size_t i = 1; i <= kResidentExtensions; i++) {
+    rf.removeBroadcast(base + i);
+  }
+}
+
+BENCHMARK(REGISTRY_broadcast_churn)->Arg(10)->Arg(100)->Arg(1000);
+}
@@ -0,0 +1,197 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/*
+ * Indirect-call heavy registry paths, each checked by -fsanitize=cfi.
+ * Compare the CFI_ results across builds with benchmarks/cfi_matrix.sh.
+ */
+
+#include <mutex>
+
+#include <benchmark/benchmark.h>
+
+#include <config.h>
+#include <registry.h>
+
+namespace osquery {
+
+/// Synthetic plugins per registry for the loop benchmarks.
+const size_t kDispatchPlugins = 64;
+
+class DispatchPlugin : public Plugin {
+ public:
+  Status setUp() override {
+    return Status(0, "OK");
+  }
+
+  void configure() override {
+    configured_++;
+  }
+
+  Status call(const PluginRequest& request, PluginResponse& response) override {
+    return Status(0, "OK");
+  }
+
+  static Status addExternal(const std::string& name,
+                            const PluginResponse& info) {
+    return Status(0, "OK");
+  }
+
+  static void removeExternal(const std::string& name) {}
+
+ private:
+  size_t configured_{0};
+};
+
+/// The same work without an indirect call, the CFI-free baseline.
+class FinalDispatchPlugin final : public DispatchPlugin {};
+
+using DispatchRegistry = RegistryType<DispatchPlugin>;
+
+static DispatchRegistry& getDispatchRegistry() {
+  static std::once_flag once;
+  static std::shared_ptr<DispatchRegistry> registry;
+  std::call_once(once, []() {
+    registry = std::make_shared<DispatchRegistry>("cfi_dispatch", true);
+    for (size_t i = 0; i < kDispatchPlugins; i++) {
+      registry->add("dispatch_" + std::to_string(i),
+                    std::make_shared<DispatchPlugin>());
+    }
+    RegistryFactory::get().add("cfi_dispatch", registry);
+  });
+  return *registry;
+}
+
+static void CFI_plugin_call(benchmark::State& state) {
+  PluginRef plugin = std::make_shared<DispatchPlugin>();
+  PluginRequest request;
+  PluginResponse response;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(plugin);
+    benchmark::DoNotOptimize(plugin->call(request, response));
+  }
+}
+
+BENCHMARK(CFI_plugin_call);
+
+static void CFI_plugin_call_final(benchmark::State& state) {
+  auto plugin = std::make_shared<FinalDispatchPlugin>();
+  PluginRequest request;
+  PluginResponse response;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(plugin);
+    benchmark::DoNotOptimize(plugin->call(request, response));
+  }
+}
+
+BENCHMARK(CFI_plugin_call_final);
+
+static void CFI_registry_call(benchmark::State& state) {
+  getDispatchRegistry();
+  PluginRequest request;
+  PluginResponse response;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(
+        RegistryFactory::call("cfi_dispatch", "dispatch_0", request, response));
+  }
+}
+
+BENCHMARK(CFI_registry_call);
+
+static void CFI_registry_trampoline(benchmark::State& state) {
+  auto* registry = &getDispatchRegistry();
+  PluginResponse info;
+  const std::string name = "dispatch_external";
+  while (state.KeepRunning()) {
+    // Hide the dynamic type so both calls stay indirect.
+    benchmark::DoNotOptimize(registry);
+    benchmark::DoNotOptimize(registry->addExternalPlugin(name, info));
+    registry->removeExternalPlugin(name);
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+
+BENCHMARK(CFI_registry_trampoline);
+
+static void CFI_registry_configure(benchmark::State& state) {
+  auto& registry = getDispatchRegistry();
+  while (state.KeepRunning()) {
+    registry.configure();
+  }
+  state.SetItemsProcessed(state.iterations() * kDispatchPlugins);
+}
+
+BENCHMARK(CFI_registry_configure);
+
+static void CFI_plugin_setup_loop(benchmark::State& state) {
+  auto& registry = getDispatchRegistry();
+  const auto& plugins = registry.plugins();
+  while (state.KeepRunning()) {
+    // The per-item work of RegistryFactory::setUp, without the Executor.
+    for (const auto& plugin : plugins) {
+      benchmark::DoNotOptimize(plugin.second->setUp());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kDispatchPlugins);
+}
+
+BENCHMARK(CFI_plugin_setup_loop);
+
+/// The schedule shape Config::scheduledQueries walks.
+static std::map<std::string, ScheduledQuery> makeSchedule() {
+  std::map<std::string, ScheduledQuery> schedule;
+  for (size_t i = 0; i < kDispatchPlugins; i++) {
+    ScheduledQuery query;
+    query.query = "SELECT * FROM dispatch;";
+    query.interval = i;
+    schedule["query_" + std::to_string(i)] = query;
+  }
+  return schedule;
+}
+
+static void CFI_config_predicate(benchmark::State& state) {
+  auto schedule = makeSchedule();
+  size_t total = 0;
+  std::function<void(const std::string& name, const ScheduledQuery& query)>
+      predicate = [&total](const std::string& name,
+                           const ScheduledQuery& query) {
+        total += query.interval;
+      };
+
+  while (state.KeepRunning()) {
+    for (const auto& query : schedule) {
+      predicate(query.first, query.second);
+    }
+    benchmark::DoNotOptimize(total);
+  }
+  state.SetItemsProcessed(state.iterations() * schedule.size());
+}
+
+BENCHMARK(CFI_config_predicate);
+
+static void CFI_config_predicate_inline(benchmark::State& state) {
+  auto schedule = makeSchedule();
+  size_t total = 0;
+  auto predicate = [&total](const std::string& name,
+                            const ScheduledQuery& query) {
+    total += query.interval;
+  };
+
+  while (state.KeepRunning()) {
+    for (const auto& query : schedule) {
+      predicate(query.first, query.second);
+    }
+    benchmark::DoNotOptimize(total);
+  }
+  state.SetItemsProcessed(state.iterations() * schedule.size());
+}
+
+BENCHMARK(CFI_config_predicate_inline);
+}
@@ -0,0 +1,59 @@
+#!/bin/bash
+
+# Build the benchmarks with CFI off, CFI, and cross-DSO CFI at -O0, -Os, and
+# -O2, then run the CFI_ dispatch benchmarks in each build.
+#
+# Results are written as CSV to cfi_matrix/<mode>_<opt>.csv. Edit BASE and CC
+# as in build.sh.
+
+set -e
+
+BASE=/usr/local/osquery
+CC=${BASE}/bin/clang++
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+BLACKLIST="${ROOT}/blacklist/cfi_blacklist.txt"
+OUT="${ROOT}/cfi_matrix"
+FILTER=${FILTER:-CFI_}
+
+SOURCES="broadcast.cpp config.cpp epoch.cpp executor.cpp json_document.cpp packs.cpp plugin_record.cpp plugin_stats.cpp query_batch.cpp shm_transport.cpp tables.cpp"
+BENCHMARKS="benchmarks/cfi_dispatch_benchmarks.cpp"
+
+ARGS="-g -std=c++14 -stdlib=libstdc++ -Qunused-arguments -Wno-missing-field-initializers -Wno-unused-local-typedef -Wno-deprecated-register -Wno-unknown-warning-option -fstack-protector-all -pipe -fdata-sections -ffunction-sections -fvisibility=default -D_GLIBCXX_USE_CXX11_ABI=1 -fPIE -fpie -fPIC -fpic -march=x86-64 -mno-avx -Wno-unused-parameter"
+LINKARGS2="-lboost_system-mt -lboost_filesystem-mt -lpthread -ldl -static-libstdc++ -lbenchmark -lbenchmark_main"
+
+CFI_OFF=""
+CFI_ON="-flto -fsanitize=cfi -fno-sanitize-trap=all -fsanitize-blacklist=${BLACKLIST}"
+CFI_CROSS_DSO="${CFI_ON} -fsanitize-cfi-cross-dso"
+
+mkdir -p "${OUT}"
+cd "${ROOT}"
+
+for MODE in off cfi cross_dso; do
+  case ${MODE} in
+    off) SANITIZE=${CFI_OFF} ;;
+    cfi) SANITIZE=${CFI_ON} ;;
+    cross_dso) SANITIZE=${CFI_CROSS_DSO} ;;
+  esac
+
+  for OPT in O0 Os O2; do
+    BUILD="${OUT}/${MODE}_${OPT}"
+    rm -rf "${BUILD}"
+    mkdir -p "${BUILD}"
+
+    OBJECTS=""
+    for SOURCE in ${SOURCES} ${BENCHMARKS}; do
+      OBJECT="${BUILD}/$(basename ${SOURCE} .cpp).o"
+      ${CC} -I${BASE}/include -I. -${OPT} ${ARGS} ${SANITIZE} -c -o ${OBJECT} ${SOURCE}
+      OBJECTS="${OBJECTS} ${OBJECT}"
+    done
+
+    # The registry's main is excluded, benchmark_main provides one.
+    ${CC} -I${BASE}/include -I. -${OPT} ${ARGS} ${SANITIZE} -DOSQUERY_BENCHMARKS -c -o ${BUILD}/registry.o registry.cpp
+    ${CC} -L${BASE}/lib ${SANITIZE} -o ${BUILD}/benchmarks ${OBJECTS} ${BUILD}/registry.o ${LINKARGS2}
+
+    echo "Running ${MODE} -${OPT}"
+    ${BUILD}/benchmarks --benchmark_filter=${FILTER} --benchmark_format=csv > "${OUT}/${MODE}_${OPT}.csv"
+  done
+done
+
+echo "Results in ${OUT}"
@@ -0,0 +1,317 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <malloc.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <sstream>
+
+#include <benchmark/benchmark.h>
+
+#include <boost/property_tree/json_parser.hpp>
+
+#include <config.h>
+#include <core.h>
+#include <json_document.h>
+#include <packs.h>
+
+/**
+ * This binary replaces the global allocator to measure the peak heap use of
+ * each parser, it is built separately from cfi_benchmarks.
+ *
+ * The CONFIG_strip_comments_fuzz benchmark is a differential check, it aborts
+ * the binary if stripConfigComments disagrees with a byte at a time
+ * reference.
+ */
+namespace {
+std::atomic<size_t> heap_current{0};
+std::atomic<size_t> heap_peak{0};
+}
+
+void* operator new(size_t size) {
+  auto p = std::malloc((size == 0) ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  auto current = heap_current.fetch_add(malloc_usable_size(p),
+                                        std::memory_order_relaxed) +
+                 malloc_usable_size(p);
+  auto peak = heap_peak.load(std::memory_order_relaxed);
+  while (current > peak &&
+         !heap_peak.compare_exchange_weak(peak, current,
+                                          std::memory_order_relaxed)) {
+  }
+  return p;
+}
+
+// The operator new above allocates with malloc, but GCC assumes the standard
+// operator new at inlined call sites and flags the free as a mismatch.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept {
+  if (p != nullptr) {
+    heap_current.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+    std::free(p);
+  }
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+void operator delete(void* p, size_t) noexcept {
+  operator delete(p);
+}
+
+namespace osquery {
+
+namespace pt = boost::property_tree;
+
+/// A config with a schedule and packs, roughly 100 bytes per query.
+static const std::string& getConfig(size_t queries) {
+  static std::map<size_t, std::string> configs;
+  auto& config = configs[queries];
+  if (!config.empty()) {
+    return config;
+  }
+
+  std::ostringstream out;
+  out << "{\"options\": {\"host_identifier\": \"hostname\", "
+      << "\"schedule_splay_percent\": 10},\n\"schedule\": {\n";
+  for (size_t i = 0; i < queries / 2; i++) {
+    out << ((i == 0) ? "" : ",\n") << "  \"query_" << i
+        << "\": {\"query\": \"SELECT * FROM processes WHERE pid = " << i
+        << "\", \"interval\": " << 60 + i % 3600 << ", \"snapshot\": "
+        << ((i % 2 == 0) ? "true" : "false") << "}";
+  }
+  out << "\n},\n\"packs\": {\"pack\": {\"platform\": \"linux\", "
+      << "\"version\": \"1.0.0\", \"discovery\": [\"SELECT 1\"], "
+      << "\"queries\": {\n";
+  for (size_t i = 0; i < queries - queries / 2; i++) {
+    out << ((i == 0) ? "" : ",\n") << "  \"pack_query_" << i
+        << "\": {\"query\": \"SELECT path, \\\"mode\\\" FROM file WHERE "
+        << "path LIKE '/etc/%'\", \"interval\": " << 300 + i << "}";
+  }
+  out << "\n}}},\n\"file_paths\": {\"etc\": [\"/etc/%\"]}}\n";
+  config = out.str();
+  return config;
+}
+
+static void CONFIG_parse_document(benchmark::State& state) {
+  const auto& config = getConfig(state.range(0));
+  size_t peak = 0;
+  while (state.KeepRunning()) {
+    auto base = heap_current.load();
+    heap_peak = base;
+    {
+      JSONDocument document;
+      document.parse(config);
+      benchmark::DoNotOptimize(document.root());
+    }
+    peak = heap_peak.load() - base;
+  }
+  state.SetBytesProcessed(state.iterations() * config.size());
+  state.counters["peak_bytes"] = static_cast<double>(peak);
+}
+
+BENCHMARK(CONFIG_parse_document)->Arg(1000)->Arg(10000)->Arg(50000);
+
+/// The property tree parse the config load path used before.
+static void CONFIG_parse_ptree(benchmark::State& state) {
+  const auto& config = getConfig(state.range(0));
+  size_t peak = 0;
+  while (state.KeepRunning()) {
+    auto base = heap_current.load();
+    heap_peak = base;
+    {
+      pt::ptree tree;
+      std::stringstream input(config);
+      pt::read_json(input, tree);
+      benchmark::DoNotOptimize(tree);
+    }
+    peak = heap_peak.load() - base;
+  }
+  state.SetBytesProcessed(state.iterations() * config.size());
+  state.counters["peak_bytes"] = static_cast<double>(peak);
+}
+
+BENCHMARK(CONFIG_parse_ptree)->Arg(1000)->Arg(10000)->Arg(50000);
+
+/// Parse, then build the schedule's packs, as Config::updateSource does.
+static void CONFIG_parse_document_packs(benchmark::State& state) {
+  const auto& config = getConfig(state.range(0));
+  while (state.KeepRunning()) {
+    JSONDocument document;
+    document.parse(config);
+    auto root = document.root();
+    Pack main("main", "benchmark", JSONValue());
+    main.addQueries(root["schedule"]);
+    for (const auto& pack : root["packs"]) {
+      Pack item(pack.getKey().to_string(), "benchmark", pack);
+      benchmark::DoNotOptimize(item.getSchedule().size());
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * config.size());
+}
+
+BENCHMARK(CONFIG_parse_document_packs)->Arg(10000);
+
+/// Parse, then adapt for a parser that only implements the ptree update.
+static void CONFIG_parse_document_to_ptree(benchmark::State& state) {
+  const auto& config = getConfig(state.range(0));
+  while (state.KeepRunning()) {
+    JSONDocument document;
+    document.parse(config);
+    pt::ptree tree;
+    toPtree(document.root()["options"], tree);
+    benchmark::DoNotOptimize(tree);
+  }
+  state.SetBytesProcessed(state.iterations() * config.size());
+}
+
+BENCHMARK(CONFIG_parse_document_to_ptree)->Arg(10000);
+
+/// The reference comment stripper, one byte and one state at a time.
+static std::string stripCommentsReference(const std::string& json) {
+  enum class State { kJSON, kString, kLine, kBlock } state = State::kJSON;
+  std::string out;
+  for (size_t i = 0; i < json.size(); i++) {
+    char c = json[i];
+    char next = (i + 1 < json.size()) ? json[i + 1] : '\0';
+    switch (state) {
+    case State::kJSON:
+      if (c == '#' || (c == '/' && next == '/')) {
+        state = State::kLine;
+      } else if (c == '/' && next == '*') {
+        state = State::kBlock;
+        i++;
+      } else {
+        state = (c == '"') ? State::kString : State::kJSON;
+        out += c;
+      }
+      break;
+    case State::kString:
+      out += c;
+      if (c == '\\' && i + 1 < json.size()) {
+        out += json[++i];
+      } else if (c == '"') {
+        state = State::kJSON;
+      }
+      break;
+    case State::kLine:
+      if (c == '\n') {
+        out += c;
+        state = State::kJSON;
+      }
+      break;
+    case State::kBlock:
+      if (c == '*' && next == '/') {
+        state = State::kJSON;
+        i++;
+      }
+      break;
+    }
+  }
+  return out;
+}
+
+/// A config where every query is preceded by comments.
+static const std::string& getCommentedConfig(size_t queries) {
+  static std::map<size_t, std::string> configs;
+  auto& config = configs[queries];
+  if (!config.empty()) {
+    return config;
+  }
+
+  std::ostringstream out;
+  out << "{\n# Generated for benchmarking.\n\"schedule\": {\n";
+  for (size_t i = 0; i < queries; i++) {
+    out << ((i == 0) ? "" : ",\n")
+        << "  // Query " << i << " reads \"processes\", see /* below */\n"
+        << "  /* It runs every minute,\n     with a splay. */\n"
+        << "  \"query_" << i << "\": {\"query\": \"SELECT * FROM file "
+        << "WHERE path LIKE '/etc/#%//%'\", \"interval\": 60}";
+  }
+  out << "\n}\n}\n";
+  config = out.str();
+  return config;
+}
+
+/// Strip a commented config, range(0) selects the vectorized scanner.
+static void CONFIG_strip_comments(benchmark::State& state) {
+  const auto& config = getCommentedConfig(20000);
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    auto json = config;
+    state.ResumeTiming();
+    if (state.range(0) != 0) {
+      stripConfigComments(json);
+    } else {
+      stripConfigCommentsScalar(json);
+    }
+    benchmark::DoNotOptimize(json);
+  }
+  state.SetBytesProcessed(state.iterations() * config.size());
+}
+
+BENCHMARK(CONFIG_strip_comments)->Arg(0)->Arg(1);
+
+/// Strip a config without comments, nothing is moved.
+static void CONFIG_strip_comments_none(benchmark::State& state) {
+  auto json = getConfig(50000);
+  while (state.KeepRunning()) {
+    if (state.range(0) != 0) {
+      stripConfigComments(json);
+    } else {
+      stripConfigCommentsScalar(json);
+    }
+    benchmark::DoNotOptimize(json);
+  }
+  state.SetBytesProcessed(state.iterations() * json.size());
+}
+
+BENCHMARK(CONFIG_strip_comments_none)->Arg(0)->Arg(1);
+
+/// Compare both scanners to the reference on random comment-heavy inputs.
+static void CONFIG_strip_comments_fuzz(benchmark::State& state) {
+  static const char kAlphabet[] = "\"\\/*#\n a{}:,";
+  std::mt19937 rng(0x5eed);
+  std::uniform_int_distribution<size_t> length(0, 80);
+  std::uniform_int_distribution<size_t> symbol(0, sizeof(kAlphabet) - 2);
+
+  size_t cases = 0;
+  while (state.KeepRunning()) {
+    std::string input(length(rng), ' ');
+    for (auto& c : input) {
+      c = kAlphabet[symbol(rng)];
+    }
+
+    auto expected = stripCommentsReference(input);
+    auto vectorized = input;
+    stripConfigComments(vectorized);
+    auto scalar = input;
+    stripConfigCommentsScalar(scalar);
+    if (vectorized != expected || scalar != expected) {
+      // A wrong result is a bug, not a slow case, fail the whole run.
+      std::fprintf(stderr, "Mismatch stripping: %s\n", input.c_str());
+      std::abort();
+    }
+    cases++;
+  }
+  state.counters["cases"] = static_cast<double>(cases);
+}
+
+BENCHMARK(CONFIG_strip_comments_fuzz)->Iterations(1000000);
+}
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <mutex>
+
+#include <benchmark/benchmark.h>
+
+#include <registry.h>
+
+namespace osquery {
+
+class LookupPlugin : public Plugin {
+ public:
+  Status call(const PluginRequest& request, PluginResponse& response) override {
+    return Status(0, "OK");
+  }
+};
+
+static void setUpLookup() {
+  static std::once_flag once;
+  std::call_once(once, []() {
+    auto lookup = std::make_shared<RegistryType<LookupPlugin>>("lookup");
+    lookup->add("lookup_item", std::make_shared<LookupPlugin>());
+    RegistryFactory::get().add("lookup", lookup);
+  });
+}
+
+/// One hit for every state.range(0) - 1 misses.
+static const std::string& lookupRegistryName(size_t i, size_t period) {
+  static const std::string hit = "lookup";
+  static const std::string miss = "lookup_missing";
+  return (i % period == 0) ? hit : miss;
+}
+
+static void LOOKUP_call_unknown_registry(benchmark::State& state) {
+  setUpLookup();
+  PluginRequest request;
+  PluginResponse response;
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& name = lookupRegistryName(i++, state.range(0));
+    benchmark::DoNotOptimize(
+        RegistryFactory::call(name, "lookup_item", request, response));
+  }
+}
+
+BENCHMARK(LOOKUP_call_unknown_registry)->Arg(1)->Arg(2)->Arg(100);
+
+/// The pre-tryRegistry miss path, each miss throws and is caught.
+static void LOOKUP_call_unknown_registry_throwing(benchmark::State& state) {
+  setUpLookup();
+  auto& rf = RegistryFactory::get();
+  PluginRequest request;
+  PluginResponse response;
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& name = lookupRegistryName(i++, state.range(0));
+    try {
+      benchmark::DoNotOptimize(
+          rf.plugin(name, "lookup_item")->call(request, response));
+    } catch (const std::exception& e) {
+      benchmark::DoNotOptimize(Status(1, e.what()));
+    }
+  }
+}
+
+BENCHMARK(LOOKUP_call_unknown_registry_throwing)->Arg(1)->Arg(2)->Arg(100);
+
+static void LOOKUP_call_unknown_item(benchmark::State& state) {
+  setUpLookup();
+  PluginRequest request;
+  PluginResponse response;
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const char* item =
+        (i++ % state.range(0) == 0) ? "lookup_item" : "lookup_item_missing";
+    benchmark::DoNotOptimize(
+        RegistryFactory::call("lookup", item, request, response));
+  }
+}
+
+BENCHMARK(LOOKUP_call_unknown_item)->Arg(1)->Arg(2)->Arg(100);
+
+static void LOOKUP_exists_unknown_registry(benchmark::State& state) {
+  setUpLookup();
+  auto& rf = RegistryFactory::get();
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& name = lookupRegistryName(i++, state.range(0));
+    benchmark::DoNotOptimize(rf.exists(name, "lookup_item"));
+  }
+}
+
+BENCHMARK(LOOKUP_exists_unknown_registry)->Arg(1)->Arg(100);
+
+static void LOOKUP_count_unknown_registry(benchmark::State& state) {
+  setUpLookup();
+  auto& rf = RegistryFactory::get();
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& name = lookupRegistryName(i++, state.range(0));
+    benchmark::DoNotOptimize(rf.count(name));
+  }
+}
+
+BENCHMARK(LOOKUP_count_unknown_registry)->Arg(1)->Arg(100);
+
+static void LOOKUP_try_plugin(benchmark::State& state) {
+  setUpLookup();
+  auto& rf = RegistryFactory::get();
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& name = lookupRegistryName(i++, state.range(0));
+    benchmark::DoNotOptimize(rf.tryPlugin(name, "lookup_item"));
+  }
+}
+
+BENCHMARK(LOOKUP_try_plugin)->Arg(1)->Arg(100);
+}
@@ -0,0 +1,179 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <registry.h>
+
+namespace osquery {
+
+static const std::string kLongValue(64, 'v');
+
+static void PLUGIN_request_map_build(benchmark::State& state) {
+  while (state.KeepRunning()) {
+    PluginRequest request;
+    request["action"] = "generate";
+    request["name"] = "benchmark_table";
+    request["context"] = kLongValue;
+    request["path"] = "/var/osquery/benchmark";
+    benchmark::DoNotOptimize(request);
+  }
+}
+
+BENCHMARK(PLUGIN_request_map_build);
+
+static void PLUGIN_request_record_build(benchmark::State& state) {
+  static const auto kAction = internPluginKey("action");
+  static const auto kName = internPluginKey("name");
+  static const auto kContext = internPluginKey("context");
+  static const auto kPath = internPluginKey("path");
+  while (state.KeepRunning()) {
+    PluginRecord request;
+    request.set(kAction, "generate");
+    request.set(kName, "benchmark_table");
+    request.set(kContext, kLongValue);
+    request.set(kPath, "/var/osquery/benchmark");
+    benchmark::DoNotOptimize(request);
+  }
+}
+
+BENCHMARK(PLUGIN_request_record_build);
+
+static void PLUGIN_request_record_build_uninterned(benchmark::State& state) {
+  while (state.KeepRunning()) {
+    PluginRecord request;
+    request.set("action", "generate");
+    request.set("name", "benchmark_table");
+    request.set("context", kLongValue);
+    request.set("path", "/var/osquery/benchmark");
+    benchmark::DoNotOptimize(request);
+  }
+}
+
+BENCHMARK(PLUGIN_request_record_build_uninterned);
+
+static void PLUGIN_request_map_lookup(benchmark::State& state) {
+  PluginRequest request = {{"action", "generate"},
+                           {"name", "benchmark_table"},
+                           {"context", kLongValue},
+                           {"path", "/var/osquery/benchmark"}};
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(request.count("action") > 0 &&
+                             request.at("action") == "generate");
+  }
+}
+
+BENCHMARK(PLUGIN_request_map_lookup);
+
+static void PLUGIN_request_record_lookup(benchmark::State& state) {
+  PluginRecord request;
+  request.set("action", "generate");
+  request.set("name", "benchmark_table");
+  request.set("context", kLongValue);
+  request.set("path", "/var/osquery/benchmark");
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(request.get("action") == "generate");
+  }
+}
+
+BENCHMARK(PLUGIN_request_record_lookup);
+
+static void PLUGIN_request_map_destroy(benchmark::State& state) {
+  PluginRequest prototype = {{"action", "generate"},
+                             {"name", "benchmark_table"},
+                             {"context", kLongValue},
+                             {"path", "/var/osquery/benchmark"}};
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    auto request = new PluginRequest(prototype);
+    state.ResumeTiming();
+    delete request;
+  }
+}
+
+BENCHMARK(PLUGIN_request_map_destroy);
+
+static void PLUGIN_request_record_destroy(benchmark::State& state) {
+  PluginRecord prototype;
+  prototype.set("action", "generate");
+  prototype.set("name", "benchmark_table");
+  prototype.set("context", kLongValue);
+  prototype.set("path", "/var/osquery/benchmark");
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    auto request = new PluginRecord(prototype);
+    state.ResumeTiming();
+    delete request;
+  }
+}
+
+BENCHMARK(PLUGIN_request_record_destroy);
+
+static void PLUGIN_request_record_adapt(benchmark::State& state) {
+  PluginRequest request = {{"action", "generate"},
+                           {"name", "benchmark_table"},
+                           {"context", kLongValue},
+                           {"path", "/var/osquery/benchmark"}};
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(PluginRecord(request).toMap());
+  }
+}
+
+BENCHMARK(PLUGIN_request_record_adapt);
+
+/// Reads the action from either request representation.
+class RecordBenchmarkPlugin : public Plugin {
+ public:
+  Status call(const PluginRequest& request, PluginResponse& response) override {
+    auto action = request.find("action");
+    return Status((action != request.end() && action->second == "generate")
+                      ? 0
+                      : 1);
+  }
+
+  Status callRecord(const PluginRecord& request,
+                    PluginResponse& response) override {
+    static const auto kAction = internPluginKey("action");
+    auto action = request.find(kAction);
+    return Status((action != nullptr && *action == "generate") ? 0 : 1);
+  }
+};
+
+static void PLUGIN_request_map_call(benchmark::State& state) {
+  RecordBenchmarkPlugin plugin;
+  PluginResponse response;
+  while (state.KeepRunning()) {
+    PluginRequest request;
+    request["action"] = "generate";
+    request["name"] = "benchmark_table";
+    request["context"] = kLongValue;
+    benchmark::DoNotOptimize(plugin.call(request, response));
+  }
+}
+
+BENCHMARK(PLUGIN_request_map_call);
+
+static void PLUGIN_request_record_call(benchmark::State& state) {
+  static const auto kAction = internPluginKey("action");
+  static const auto kName = internPluginKey("name");
+  static const auto kContext = internPluginKey("context");
+  RecordBenchmarkPlugin plugin;
+  PluginResponse response;
+  while (state.KeepRunning()) {
+    PluginRecord request;
+    request.set(kAction, "generate");
+    request.set(kName, "benchmark_table");
+    request.set(kContext, kLongValue);
+    benchmark::DoNotOptimize(plugin.callRecord(request, response));
+  }
+}
+
+BENCHMARK(PLUGIN_request_record_call);
+}
@@ -0,0 +1,96 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <mutex>
+
+#include <benchmark/benchmark.h>
+
+#include <plugin_stats.h>
+#include <registry.h>
+
+namespace osquery {
+
+class StatsPlugin : public Plugin {
+ public:
+  Status call(const PluginRequest& request, PluginResponse& response) override {
+    return Status(0, "OK");
+  }
+};
+
+static void ensureStatsRegistry() {
+  static std::once_flag once;
+  std::call_once(once, []() {
+    auto registry =
+        std::make_shared<RegistryType<StatsPlugin>>("benchmark_stats");
+    registry->add("stats", std::make_shared<StatsPlugin>());
+    RegistryFactory::get().add("benchmark_stats", registry);
+  });
+}
+
+/// The recording cost alone, per thread.
+static void STATS_record(benchmark::State& state) {
+  auto id = PluginStats::get().id("benchmark_stats", "record");
+  uint64_t nanoseconds = 0;
+  while (state.KeepRunning()) {
+    PluginStats::get().record(id, nanoseconds++ & 0xFFFF, false, 16, 64);
+  }
+}
+
+BENCHMARK(STATS_record)->ThreadRange(1, 8)->UseRealTime();
+
+/// Counting a call, the only cost of a call that is not sampled.
+static void STATS_count(benchmark::State& state) {
+  auto id = PluginStats::get().id("benchmark_stats", "count");
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(PluginStats::count(id));
+  }
+}
+
+BENCHMARK(STATS_count)->ThreadRange(1, 8)->UseRealTime();
+
+/// A call's timer, averaged over the sampled and the counted calls.
+static void STATS_timer(benchmark::State& state) {
+  auto id = PluginStats::get().id("benchmark_stats", "timer");
+  PluginRequest request = {{"action", "generate"}};
+  PluginResponse response;
+  while (state.KeepRunning()) {
+    PluginCallTimer timer(id);
+    timer.finish(true, request, response, 0);
+  }
+}
+
+BENCHMARK(STATS_timer)->ThreadRange(1, 8)->UseRealTime();
+
+static void STATS_registry_call(benchmark::State& state) {
+  ensureStatsRegistry();
+  PluginStats::get().enabled(state.range(0) != 0);
+  PluginRequest request = {{"action", "generate"}};
+  PluginResponse response;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(
+        RegistryFactory::call("benchmark_stats", "stats", request, response));
+  }
+  PluginStats::get().enabled(true);
+}
+
+BENCHMARK(STATS_registry_call)->Arg(0)->Arg(1);
+
+static void STATS_snapshot(benchmark::State& state) {
+  ensureStatsRegistry();
+  PluginRequest request;
+  PluginResponse response;
+  RegistryFactory::call("benchmark_stats", "stats", request, response);
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(PluginStats::get().snapshot());
+  }
+}
+
+BENCHMARK(STATS_snapshot);
+}
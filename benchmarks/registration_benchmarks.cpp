@@ -0,0 +1,141 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <mutex>
+
+#include <benchmark/benchmark.h>
+
+#include <registry.h>
+
+namespace osquery {
+
+class StartupPlugin : public Plugin {
+ public:
+  Status call(const PluginRequest& request, PluginResponse& response) override {
+    return Status(0, "OK");
+  }
+};
+
+/// Synthetic registrations, equivalent to thousands of REGISTER macros.
+struct SyntheticRegistrations {
+  explicit SyntheticRegistrations(size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      names.push_back("startup_item_" + std::to_string(i));
+    }
+
+    // The same layout the linker section provides.
+    for (const auto& name : names) {
+      records.push_back({"benchmark_startup",
+                         name.c_str(),
+                         false,
+                         &registries::createPlugin<StartupPlugin>});
+    }
+  }
+
+  std::vector<std::string> names;
+  std::vector<PluginRegistration> records;
+};
+
+static SyntheticRegistrations& getRegistrations(size_t count) {
+  static std::map<size_t, std::unique_ptr<SyntheticRegistrations>> all;
+  auto& registrations = all[count];
+  if (registrations == nullptr) {
+    registrations.reset(new SyntheticRegistrations(count));
+  }
+  return *registrations;
+}
+
+/// Prepare an empty target registry, outside of the timed region.
+static void resetStartupRegistry(const SyntheticRegistrations& registrations) {
+  static std::once_flag once;
+  std::call_once(once, []() {
+    RegistryFactory::get().add(
+        "benchmark_startup",
+        std::make_shared<RegistryType<StartupPlugin>>("benchmark_startup"));
+  });
+
+  auto registry = RegistryFactory::get().registry("benchmark_startup");
+  for (const auto& name : registrations.names) {
+    registry->remove(name);
+  }
+}
+
+static void REGISTRY_startup_static(benchmark::State& state) {
+  const auto& registrations = getRegistrations(state.range(0));
+  const auto* begin = registrations.records.data();
+  const auto* end = begin + registrations.records.size();
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    resetStartupRegistry(registrations);
+    state.ResumeTiming();
+
+    registerPlugins(begin, end);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(REGISTRY_startup_static)->Arg(1000)->Arg(10000);
+
+static void REGISTRY_startup_dynamic(benchmark::State& state) {
+  const auto& registrations = getRegistrations(state.range(0));
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    resetStartupRegistry(registrations);
+    state.ResumeTiming();
+
+    // Static initialization queues one heap-allocated AP per registration.
+    AutoRegisterSet plugins;
+    for (const auto& name : registrations.names) {
+      plugins.push_back(
+          std::make_unique<registries::AP<StartupPlugin>>(
+              "benchmark_startup", name.c_str(), false));
+    }
+
+    for (const auto& it : plugins) {
+      it->run();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(REGISTRY_startup_dynamic)->Arg(1000)->Arg(10000);
+
+/// The registration pass alone, without adding plugins to a registry.
+static void REGISTRY_startup_static_iterate(benchmark::State& state) {
+  const auto& registrations = getRegistrations(state.range(0));
+  while (state.KeepRunning()) {
+    for (const auto& record : registrations.records) {
+      benchmark::DoNotOptimize(record.create);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(REGISTRY_startup_static_iterate)->Arg(1000)->Arg(10000);
+
+static void REGISTRY_startup_dynamic_iterate(benchmark::State& state) {
+  const auto& registrations = getRegistrations(state.range(0));
+  while (state.KeepRunning()) {
+    AutoRegisterSet plugins;
+    for (const auto& name : registrations.names) {
+      plugins.push_back(
+          std::make_unique<registries::AP<StartupPlugin>>(
+              "benchmark_startup", name.c_str(), false));
+    }
+
+    for (const auto& it : plugins) {
+      benchmark::DoNotOptimize(it->name_.data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(REGISTRY_startup_dynamic_iterate)->Arg(1000)->Arg(10000);
+}
@@ -0,0 +1,380 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include <registry.h>
+
+namespace osquery {
+
+class BenchmarkPlugin : public Plugin {
+ public:
+  Status call(const PluginRequest& request, PluginResponse& response) override {
+    return Status(0, "OK");
+  }
+};
+
+/// A final plugin, calls through callFinal need no virtual dispatch.
+class FinalBenchmarkPlugin final : public BenchmarkPlugin {
+ public:
+  Status call(const PluginRequest& request, PluginResponse& response) override {
+    return Status(0, "OK");
+  }
+};
+
+class BenchmarkRegistry : public RegistryType<BenchmarkPlugin> {
+ public:
+  explicit BenchmarkRegistry(size_t items) : RegistryType("benchmark") {
+    for (size_t i = 0; i < items; i++) {
+      auto name = "benchmark_item_" + std::to_string(i);
+      auto plugin = std::make_shared<BenchmarkPlugin>();
+      // Every tenth item is internal.
+      auto internal = (i % 10 == 0);
+      add(name, plugin, internal);
+      addAlias(name, "benchmark_alias_" + std::to_string(i));
+      if (internal) {
+        list_internal_.push_back(name);
+      }
+      map_items_[name] = plugin;
+      map_aliases_["benchmark_alias_" + std::to_string(i)] = name;
+      names_.push_back(name);
+    }
+  }
+
+  using RegistryInterface::addAlias;
+  using RegistryInterface::call;
+  using RegistryInterface::getAlias;
+
+ public:
+  /// The pre-index std::map tables, used as a baseline.
+  std::map<std::string, PluginRef> map_items_;
+  std::map<std::string, std::string> map_aliases_;
+
+  /// The pre-index internal item list, used as a baseline.
+  std::vector<std::string> list_internal_;
+
+  /// Names to look up, in registration order.
+  std::vector<std::string> names_;
+};
+
+static BenchmarkRegistry& getRegistry(size_t items) {
+  static std::map<size_t, std::unique_ptr<BenchmarkRegistry>> registries;
+  auto& registry = registries[items];
+  if (registry == nullptr) {
+    registry.reset(new BenchmarkRegistry(items));
+  }
+  return *registry;
+}
+
+static void REGISTRY_call(benchmark::State& state) {
+  auto& registry = getRegistry(state.range(0));
+  PluginRequest request;
+  PluginResponse response;
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& name = registry.names_[i++ % registry.names_.size()];
+    benchmark::DoNotOptimize(registry.call(name, request, response));
+  }
+}
+
+BENCHMARK(REGISTRY_call)->Arg(10000)->Arg(100000);
+
+static void REGISTRY_call_map(benchmark::State& state) {
+  auto& registry = getRegistry(state.range(0));
+  PluginRequest request;
+  PluginResponse response;
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& name = registry.names_[i++ % registry.names_.size()];
+    if (registry.map_items_.count(name) > 0) {
+      benchmark::DoNotOptimize(
+          registry.map_items_.at(name)->call(request, response));
+    }
+  }
+}
+
+BENCHMARK(REGISTRY_call_map)->Arg(10000)->Arg(100000);
+
+static void REGISTRY_exists(benchmark::State& state) {
+  auto& registry = getRegistry(state.range(0));
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& name = registry.names_[i++ % registry.names_.size()];
+    benchmark::DoNotOptimize(registry.exists(name));
+  }
+}
+
+BENCHMARK(REGISTRY_exists)->Arg(10000)->Arg(100000);
+
+static void REGISTRY_exists_map(benchmark::State& state) {
+  auto& registry = getRegistry(state.range(0));
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& name = registry.names_[i++ % registry.names_.size()];
+    benchmark::DoNotOptimize(registry.map_items_.count(name) > 0);
+  }
+}
+
+BENCHMARK(REGISTRY_exists_map)->Arg(10000)->Arg(100000);
+
+static void REGISTRY_plugin(benchmark::State& state) {
+  auto& registry = getRegistry(state.range(0));
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& name = registry.names_[i++ % registry.names_.size()];
+    benchmark::DoNotOptimize(registry.plugin(name));
+  }
+}
+
+BENCHMARK(REGISTRY_plugin)->Arg(10000)->Arg(100000);
+
+static void REGISTRY_plugin_map(benchmark::State& state) {
+  auto& registry = getRegistry(state.range(0));
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& name = registry.names_[i++ % registry.names_.size()];
+    if (registry.map_items_.count(name) > 0) {
+      benchmark::DoNotOptimize(registry.map_items_.at(name));
+    }
+  }
+}
+
+BENCHMARK(REGISTRY_plugin_map)->Arg(10000)->Arg(100000);
+
+static void REGISTRY_getAlias(benchmark::State& state) {
+  auto& registry = getRegistry(state.range(0));
+  std::vector<std::string> aliases;
+  for (const auto& alias : registry.map_aliases_) {
+    aliases.push_back(alias.first);
+  }
+
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& alias = aliases[i++ % aliases.size()];
+    benchmark::DoNotOptimize(registry.getAlias(alias));
+  }
+}
+
+BENCHMARK(REGISTRY_getAlias)->Arg(10000)->Arg(100000);
+
+static void REGISTRY_getAlias_map(benchmark::State& state) {
+  auto& registry = getRegistry(state.range(0));
+  std::vector<std::string> aliases;
+  for (const auto& alias : registry.map_aliases_) {
+    aliases.push_back(alias.first);
+  }
+
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& alias = aliases[i++ % aliases.size()];
+    std::string item = (registry.map_aliases_.count(alias) == 0)
+                           ? alias
+                           : registry.map_aliases_.at(alias);
+    benchmark::DoNotOptimize(item);
+  }
+}
+
+BENCHMARK(REGISTRY_getAlias_map)->Arg(10000)->Arg(100000);
+
+static void REGISTRY_getRoutes(benchmark::State& state) {
+  auto& registry = getRegistry(state.range(0));
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(registry.getRoutes());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(REGISTRY_getRoutes)->Arg(10000);
+
+/// The pre-index getRoutes, scanning every alias for every item.
+static void REGISTRY_getRoutes_scan(benchmark::State& state) {
+  auto& registry = getRegistry(state.range(0));
+  while (state.KeepRunning()) {
+    RegistryRoutes route_table;
+    for (const auto& item : registry.map_items_) {
+      bool has_alias = false;
+      for (const auto& alias : registry.map_aliases_) {
+        if (alias.second == item.first) {
+          route_table[alias.first] = item.second->routeInfo();
+          has_alias = true;
+        }
+      }
+      if (!has_alias) {
+        route_table[item.first] = item.second->routeInfo();
+      }
+    }
+    benchmark::DoNotOptimize(route_table);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(REGISTRY_getRoutes_scan)->Arg(10000);
+
+static void REGISTRY_remove(benchmark::State& state) {
+  auto& registry = getRegistry(state.range(0));
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    // Remove an item and its alias, then restore both.
+    auto index = i++ % registry.names_.size();
+    const auto& name = registry.names_[index];
+    registry.remove(name);
+    registry.add(name, registry.map_items_[name], index % 10 == 0);
+    registry.addAlias(name, "benchmark_alias_" + std::to_string(index));
+  }
+}
+
+BENCHMARK(REGISTRY_remove)->Arg(10000);
+
+static void REGISTRY_isInternal(benchmark::State& state) {
+  auto& registry = getRegistry(state.range(0));
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& name = registry.names_[i++ % registry.names_.size()];
+    benchmark::DoNotOptimize(registry.isInternal(name));
+  }
+}
+
+BENCHMARK(REGISTRY_isInternal)->Arg(10000);
+
+static void REGISTRY_isInternal_scan(benchmark::State& state) {
+  auto& registry = getRegistry(state.range(0));
+  const auto& internal = registry.list_internal_;
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& name = registry.names_[i++ % registry.names_.size()];
+    benchmark::DoNotOptimize(std::find(internal.begin(), internal.end(),
+                                       name) != internal.end());
+  }
+}
+
+BENCHMARK(REGISTRY_isInternal_scan)->Arg(10000);
+
+/// Register a small registry with the factory for the multi-threaded reads.
+static void addFactoryRegistry() {
+  static std::once_flag once;
+  std::call_once(once, []() {
+    auto registry = std::make_shared<BenchmarkRegistry>(16);
+    registry->add("benchmark_final", std::make_shared<FinalBenchmarkPlugin>());
+    RegistryFactory::get().add("benchmark_factory", registry);
+  });
+}
+
+/// The pre-snapshot registry table, a map behind a reader/writer lock.
+static std::map<std::string, RegistryInterfaceRef> kLockedRegistries;
+static Mutex kLockedRegistriesMutex;
+
+static int maxBenchmarkThreads() {
+  return std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+static void REGISTRY_factory_exists(benchmark::State& state) {
+  addFactoryRegistry();
+  auto& rf = RegistryFactory::get();
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(
+        rf.exists("benchmark_factory", "benchmark_item_1"));
+  }
+}
+
+BENCHMARK(REGISTRY_factory_exists)->ThreadRange(1, maxBenchmarkThreads());
+
+static void REGISTRY_factory_exists_locked(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    addFactoryRegistry();
+    WriteLock lock(kLockedRegistriesMutex);
+    kLockedRegistries = RegistryFactory::get().all();
+  }
+
+  while (state.KeepRunning()) {
+    ReadLock lock(kLockedRegistriesMutex);
+    auto it = kLockedRegistries.find("benchmark_factory");
+    benchmark::DoNotOptimize(it != kLockedRegistries.end() &&
+                             it->second->exists("benchmark_item_1"));
+  }
+}
+
+BENCHMARK(REGISTRY_factory_exists_locked)
+    ->ThreadRange(1, maxBenchmarkThreads());
+
+static void REGISTRY_factory_call(benchmark::State& state) {
+  addFactoryRegistry();
+  PluginRequest request;
+  PluginResponse response;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(RegistryFactory::call(
+        "benchmark_factory", "benchmark_item_1", request, response));
+  }
+}
+
+BENCHMARK(REGISTRY_factory_call)->ThreadRange(1, maxBenchmarkThreads());
+
+static void REGISTRY_factory_call_handle(benchmark::State& state) {
+  addFactoryRegistry();
+  auto handle =
+      RegistryFactory::resolve("benchmark_factory", "benchmark_item_1");
+  PluginRequest request;
+  PluginResponse response;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(RegistryFactory::call(handle, request, response));
+  }
+}
+
+BENCHMARK(REGISTRY_factory_call_handle)->ThreadRange(1, maxBenchmarkThreads());
+
+static void REGISTRY_factory_call_final(benchmark::State& state) {
+  addFactoryRegistry();
+  PluginRequest request;
+  PluginResponse response;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(RegistryFactory::callFinal<FinalBenchmarkPlugin>(
+        "benchmark_factory", "benchmark_final", request, response));
+  }
+}
+
+BENCHMARK(REGISTRY_factory_call_final);
+
+static void REGISTRY_factory_call_virtual(benchmark::State& state) {
+  addFactoryRegistry();
+  PluginRequest request;
+  PluginResponse response;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(RegistryFactory::call(
+        "benchmark_factory", "benchmark_final", request, response));
+  }
+}
+
+BENCHMARK(REGISTRY_factory_call_virtual);
+
+static void REGISTRY_factory_typed_plugin(benchmark::State& state) {
+  addFactoryRegistry();
+  auto& rf = RegistryFactory::get();
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(rf.typedPlugin<BenchmarkPlugin>(
+        "benchmark_factory", "benchmark_item_1"));
+  }
+}
+
+BENCHMARK(REGISTRY_factory_typed_plugin);
+
+static void REGISTRY_factory_plugin_dynamic_cast(benchmark::State& state) {
+  addFactoryRegistry();
+  auto& rf = RegistryFactory::get();
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(std::dynamic_pointer_cast<BenchmarkPlugin>(
+        rf.plugin("benchmark_factory", "benchmark_item_1")));
+  }
+}
+
+BENCHMARK(REGISTRY_factory_plugin_dynamic_cast);
+}
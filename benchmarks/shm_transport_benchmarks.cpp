@@ -0,0 +1,296 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/*
+ * Extension call latency through a shared-memory channel and, as the
+ * baseline, a Unix socket. Both reach the same forked stand-in extension
+ * and use the same frame codec, so the difference is the transport.
+ */
+
+#ifdef __linux__
+
+#include <mutex>
+#include <thread>
+
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include <registry.h>
+#include <shm_transport.h>
+
+namespace osquery {
+
+const RouteUUID kShmExtension = 0x5348;
+const RouteUUID kSocketExtension = 0x534f;
+
+/// Frame capacity of the benchmark channel.
+const size_t kBenchmarkRingSize = 1 << 20;
+
+static bool writeAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    auto written = ::write(fd, data, size);
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+static bool readAll(int fd, char* data, size_t size) {
+  while (size > 0) {
+    auto got = ::read(fd, data, size);
+    if (got <= 0) {
+      return false;
+    }
+    data += got;
+    size -= static_cast<size_t>(got);
+  }
+  return true;
+}
+
+static bool writeFrame(int fd, const std::string& frame) {
+  uint64_t size = frame.size();
+  return writeAll(fd, reinterpret_cast<const char*>(&size), sizeof(size)) &&
+         writeAll(fd, frame.data(), frame.size());
+}
+
+static bool readFrame(int fd, std::string& frame) {
+  uint64_t size = 0;
+  if (!readAll(fd, reinterpret_cast<char*>(&size), sizeof(size))) {
+    return false;
+  }
+  frame.resize(size);
+  return readAll(fd, &frame[0], size);
+}
+
+/// The baseline transport, one stream socket per extension.
+class SocketTransport : public ExtensionTransport {
+ public:
+  explicit SocketTransport(int fd) : fd_(fd) {}
+
+  Status call(const std::string& registry_name,
+              const std::string& item_name,
+              const PluginRequest& request,
+              PluginResponse& response) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto id = ++next_id_;
+    buffer_.resize(
+        extensionRequestSize(registry_name, item_name, &request, 1));
+    encodeExtensionRequest(
+        id, registry_name, item_name, &request, 1, &buffer_[0]);
+    if (!writeFrame(fd_, buffer_) || !readFrame(fd_, buffer_)) {
+      return Status(1, "Extension socket failed");
+    }
+
+    uint64_t response_id = 0;
+    std::vector<PluginCallResult> results;
+    auto status = decodeExtensionResponse(buffer_, response_id, results);
+    if (!status.ok() || results.size() != 1) {
+      return Status(1, "Malformed extension response");
+    }
+    response.insert(response.end(),
+                    std::make_move_iterator(results[0].response.begin()),
+                    std::make_move_iterator(results[0].response.end()));
+    return results[0].status;
+  }
+
+ private:
+  int fd_;
+  std::mutex mutex_;
+  uint64_t next_id_{0};
+  std::string buffer_;
+};
+
+/// The stand-in extension's only plugin: reply with a value of "bytes" size.
+static Status serveEcho(const std::string& registry_name,
+                        const std::string& item_name,
+                        const PluginRequest& request,
+                        PluginResponse& response) {
+  auto bytes = request.find("bytes");
+  auto size = (bytes == request.end()) ? 0 : std::stoul(bytes->second);
+  response.push_back({{"value", std::string(size, 'x')}});
+  return Status(0, "OK");
+}
+
+static void serveSocket(int fd) {
+  std::string frame;
+  while (readFrame(fd, frame)) {
+    uint64_t id = 0;
+    std::string registry_name;
+    std::string item_name;
+    std::vector<PluginRequest> requests;
+    auto status =
+        decodeExtensionRequest(frame, id, registry_name, item_name, requests);
+    std::vector<PluginCallResult> results(requests.size());
+    for (size_t i = 0; i < requests.size(); i++) {
+      results[i].status = serveEcho(
+          registry_name, item_name, requests[i], results[i].response);
+    }
+    if (!status.ok()) {
+      results.assign(1, {status, {}});
+    }
+    frame.resize(extensionResponseSize(results.data(), results.size()));
+    encodeExtensionResponse(id, results.data(), results.size(), &frame[0]);
+    if (!writeFrame(fd, frame)) {
+      break;
+    }
+  }
+}
+
+class ExtensionPlugin : public Plugin {
+ public:
+  Status call(const PluginRequest& request, PluginResponse& response) override {
+    return Status(1, "Not a local plugin");
+  }
+};
+
+/**
+ * @brief Fork the stand-in extension and broadcast its items.
+ *
+ * The child serves both transports and dies with the benchmark process.
+ */
+static bool startExtension() {
+  static std::once_flag once;
+  static bool started = false;
+  std::call_once(once, []() {
+    ShmChannelRef channel;
+    int sockets[2];
+    if (!ShmChannel::create(kBenchmarkRingSize, channel).ok() ||
+        ::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+      return;
+    }
+
+    auto pid = ::fork();
+    if (pid < 0) {
+      return;
+    }
+
+    if (pid == 0) {
+      ::prctl(PR_SET_PDEATHSIG, SIGKILL);
+      ::close(sockets[0]);
+      std::thread socket_server([&sockets]() { serveSocket(sockets[1]); });
+      serveShmChannel(*channel, serveEcho);
+      socket_server.join();
+      ::_exit(0);
+    }
+    ::close(sockets[1]);
+
+    auto& factory = RegistryFactory::get();
+    factory.add("benchmark_extension",
+                std::make_shared<RegistryType<ExtensionPlugin>>(
+                    "benchmark_extension"));
+    factory.addBroadcast(kShmExtension, {{"benchmark_extension", {{"shm", {}}}}});
+    factory.addBroadcast(kSocketExtension,
+                         {{"benchmark_extension", {{"socket", {}}}}});
+    factory.setTransport(kShmExtension,
+                         std::make_shared<ShmExtensionTransport>(channel));
+    factory.setTransport(kSocketExtension,
+                         std::make_shared<SocketTransport>(sockets[0]));
+    started = true;
+  });
+  return started;
+}
+
+static void runExtensionCall(benchmark::State& state, const std::string& item) {
+  if (!startExtension()) {
+    state.SkipWithError("Cannot start the stand-in extension");
+    return;
+  }
+
+  PluginRequest request = {{"action", "echo"},
+                           {"bytes", std::to_string(state.range(0))}};
+  PluginResponse response;
+  while (state.KeepRunning()) {
+    response.clear();
+    auto status =
+        RegistryFactory::call("benchmark_extension", item, request, response);
+    if (!status.ok() || response.size() != 1) {
+      state.SkipWithError(status.getMessage().c_str());
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+static void EXTENSION_shm_call(benchmark::State& state) {
+  runExtensionCall(state, "shm");
+}
+
+BENCHMARK(EXTENSION_shm_call)->Arg(16)->Arg(4096)->Arg(65536)->UseRealTime();
+
+static void EXTENSION_socket_call(benchmark::State& state) {
+  runExtensionCall(state, "socket");
+}
+
+BENCHMARK(EXTENSION_socket_call)
+    ->Arg(16)
+    ->Arg(4096)
+    ->Arg(65536)
+    ->UseRealTime();
+
+/// Requests per batch for the batch benchmarks.
+const size_t kBatchRequests = 256;
+
+static void runExtensionBatch(benchmark::State& state,
+                              const std::string& item,
+                              bool batched) {
+  if (!startExtension()) {
+    state.SkipWithError("Cannot start the stand-in extension");
+    return;
+  }
+
+  std::vector<PluginRequest> requests(
+      kBatchRequests,
+      {{"action", "echo"}, {"bytes", std::to_string(state.range(0))}});
+  while (state.KeepRunning()) {
+    if (batched) {
+      auto results =
+          RegistryFactory::callBatch("benchmark_extension", item, requests);
+      benchmark::DoNotOptimize(results);
+      continue;
+    }
+
+    for (const auto& request : requests) {
+      PluginResponse response;
+      benchmark::DoNotOptimize(RegistryFactory::call(
+          "benchmark_extension", item, request, response));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchRequests);
+}
+
+static void EXTENSION_shm_batch(benchmark::State& state) {
+  runExtensionBatch(state, "shm", true);
+}
+
+BENCHMARK(EXTENSION_shm_batch)->Arg(16)->Arg(4096)->UseRealTime();
+
+static void EXTENSION_shm_batch_calls(benchmark::State& state) {
+  runExtensionBatch(state, "shm", false);
+}
+
+BENCHMARK(EXTENSION_shm_batch_calls)->Arg(16)->Arg(4096)->UseRealTime();
+
+/// The socket transport has no batching, callBatch makes a call per request.
+static void EXTENSION_socket_batch(benchmark::State& state) {
+  runExtensionBatch(state, "socket", true);
+}
+
+BENCHMARK(EXTENSION_socket_batch)->Arg(16)->Arg(4096)->UseRealTime();
+}
+
+#endif
@@ -0,0 +1,221 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <cstdint>
+
+#include <broadcast.h>
+
+namespace osquery {
+
+/// Bumped when the encoding changes incompatibly.
+const uint8_t kBroadcastDeltaVersion = 1;
+
+static void putVarint(std::string& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+static void putString(std::string& out, const std::string& value) {
+  putVarint(out, value.size());
+  out.append(value);
+}
+
+namespace {
+
+/// A bounds-checked cursor over an encoded delta.
+class DeltaReader {
+ public:
+  explicit DeltaReader(boost::string_ref input) : input_(input) {}
+
+  bool getVarint(uint64_t& value) {
+    value = 0;
+    for (size_t shift = 0; shift < 64; shift += 7) {
+      if (position_ >= input_.size()) {
+        return false;
+      }
+      auto byte = static_cast<uint8_t>(input_[position_++]);
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Read a count, each counted element needs at least one byte.
+  bool getCount(size_t& count) {
+    uint64_t value = 0;
+    if (!getVarint(value) || value > remaining()) {
+      return false;
+    }
+    count = static_cast<size_t>(value);
+    return true;
+  }
+
+  bool getString(std::string& value) {
+    size_t size = 0;
+    if (!getCount(size)) {
+      return false;
+    }
+    value.assign(input_.data() + position_, size);
+    position_ += size;
+    return true;
+  }
+
+  bool getByte(uint8_t& value) {
+    if (position_ >= input_.size()) {
+      return false;
+    }
+    value = static_cast<uint8_t>(input_[position_++]);
+    return true;
+  }
+
+  size_t remaining() const {
+    return input_.size() - position_;
+  }
+
+ private:
+  boost::string_ref input_;
+  size_t position_{0};
+};
+}
+
+void encodeRoutes(const RegistryRoutes& routes, std::string& out) {
+  putVarint(out, routes.size());
+  for (const auto& route : routes) {
+    putString(out, route.first);
+    putVarint(out, route.second.size());
+    for (const auto& row : route.second) {
+      putVarint(out, row.size());
+      for (const auto& field : row) {
+        putString(out, field.first);
+        putString(out, field.second);
+      }
+    }
+  }
+}
+
+std::string encodeBroadcast(size_t& generation) {
+  // Changes racing with the broadcast are sent with the next delta.
+  generation = RegistryFactory::broadcastGeneration();
+  auto registries = RegistryFactory::get().all();
+
+  std::string out;
+  out.push_back(static_cast<char>(kBroadcastDeltaVersion));
+  putVarint(out, generation);
+  putVarint(out, registries.size());
+  for (const auto& registry : registries) {
+    putString(out, registry.first);
+    out.append(registry.second->getRoutesCache()->encoded);
+    // Nothing is removed relative to generation 0.
+    putVarint(out, 0);
+  }
+  return out;
+}
+
+std::string encodeBroadcastDelta(size_t generation,
+                                 const RegistryBroadcastDelta& delta) {
+  std::string out;
+  out.push_back(static_cast<char>(kBroadcastDeltaVersion));
+  putVarint(out, generation);
+  putVarint(out, delta.size());
+  for (const auto& registry : delta) {
+    putString(out, registry.first);
+    encodeRoutes(registry.second.added, out);
+    putVarint(out, registry.second.removed.size());
+    for (const auto& name : registry.second.removed) {
+      putString(out, name);
+    }
+  }
+  return out;
+}
+
+Status decodeBroadcastDelta(boost::string_ref encoded,
+                            size_t& generation,
+                            RegistryBroadcastDelta& delta) {
+  DeltaReader reader(encoded);
+  uint8_t version = 0;
+  if (!reader.getByte(version) || version != kBroadcastDeltaVersion) {
+    return Status(1, STATUS_LITERAL("Unsupported broadcast delta version"));
+  }
+
+  uint64_t value = 0;
+  size_t registries = 0;
+  if (!reader.getVarint(value) || !reader.getCount(registries)) {
+    return Status(1, STATUS_LITERAL("Malformed broadcast delta"));
+  }
+  generation = static_cast<size_t>(value);
+
+  delta.clear();
+  for (size_t i = 0; i < registries; i++) {
+    std::string registry_name;
+    size_t added = 0;
+    if (!reader.getString(registry_name) || !reader.getCount(added)) {
+      return Status(1, STATUS_LITERAL("Malformed broadcast delta"));
+    }
+
+    auto& routes = delta[registry_name];
+    for (size_t j = 0; j < added; j++) {
+      std::string name;
+      size_t rows = 0;
+      if (!reader.getString(name) || !reader.getCount(rows)) {
+        return Status(1, STATUS_LITERAL("Malformed broadcast delta"));
+      }
+
+      auto& route = routes.added[name];
+      route.resize(rows);
+      for (auto& row : route) {
+        size_t fields = 0;
+        if (!reader.getCount(fields)) {
+          return Status(1, STATUS_LITERAL("Malformed broadcast delta"));
+        }
+        for (size_t k = 0; k < fields; k++) {
+          std::string key;
+          if (!reader.getString(key) || !reader.getString(row[key])) {
+            return Status(1, STATUS_LITERAL("Malformed broadcast delta"));
+          }
+        }
+      }
+    }
+
+    size_t removed = 0;
+    if (!reader.getCount(removed)) {
+      return Status(1, STATUS_LITERAL("Malformed broadcast delta"));
+    }
+    routes.removed.resize(removed);
+    for (auto& name : routes.removed) {
+      if (!reader.getString(name)) {
+        return Status(1, STATUS_LITERAL("Malformed broadcast delta"));
+      }
+    }
+  }
+
+  if (reader.remaining() != 0) {
+    return Status(1, STATUS_LITERAL("Malformed broadcast delta"));
+  }
+  return Status(0, "OK");
+}
+
+void applyBroadcastDelta(const RegistryBroadcastDelta& delta,
+                         RegistryBroadcast& broadcast) {
+  for (const auto& registry : delta) {
+    auto& routes = broadcast[registry.first];
+    for (const auto& name : registry.second.removed) {
+      routes.erase(name);
+    }
+    for (const auto& route : registry.second.added) {
+      routes[route.first] = route.second;
+    }
+  }
+}
+}
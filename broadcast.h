@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#pragma once
+
+#include <string>
+
+#include <boost/utility/string_ref.hpp>
+
+#include <registry.h>
+
+namespace osquery {
+
+/**
+ * @brief Encode a delta broadcast for transport.
+ *
+ * The encoding is a version byte followed by the generation, then each
+ * registry's added routes and removed names. Integers are LEB128 varints and
+ * strings are length-prefixed, so a typical route costs its bytes plus a few
+ * length bytes.
+ *
+ * @param generation The generation the delta brings a receiver to.
+ * @param delta From RegistryFactory::getBroadcastDelta.
+ */
+std::string encodeBroadcastDelta(size_t generation,
+                                 const RegistryBroadcastDelta& delta);
+
+/**
+ * @brief Append the encoding of one registry's routes.
+ *
+ * This is the added-routes section of encodeBroadcastDelta, registries cache
+ * it with their routes, see RegistryInterface::getRoutesCache.
+ */
+void encodeRoutes(const RegistryRoutes& routes, std::string& out);
+
+/**
+ * @brief Encode the complete broadcast as a delta from generation 0.
+ *
+ * Each registry contributes its cached route encoding, so repeated full
+ * broadcasts do not call routeInfo or re-encode unchanged registries.
+ */
+std::string encodeBroadcast(size_t& generation);
+
+/**
+ * @brief Decode a delta broadcast produced by encodeBroadcastDelta.
+ *
+ * @return Failure if the input is truncated or malformed, the outputs are
+ * then unspecified.
+ */
+Status decodeBroadcastDelta(boost::string_ref encoded,
+                            size_t& generation,
+                            RegistryBroadcastDelta& delta);
+
+/// Apply a delta to a receiver's copy of the broadcast.
+void applyBroadcastDelta(const RegistryBroadcastDelta& delta,
+                         RegistryBroadcast& broadcast);
+}
@@ -1,6 +1,6 @@
 #!/bin/bash
 
-rm -f cfi_Os cfi_O0  *.o
+rm -f cfi_Os cfi_O0 cfi_benchmarks config_benchmarks *.o
 
 BASE=/usr/local/osquery
 CC=${BASE}/bin/clang++
@@ -8,10 +8,39 @@ BLACKLIST="`pwd`/blacklist/cfi_blacklist.txt"
 
 ARGS="-g -std=c++14 -stdlib=libstdc++ -Qunused-arguments -Wstrict-aliasing -Wno-missing-field-initializers -Wno-unused-local-typedef -Wno-deprecated-register -Wno-unknown-warning-option -Wnon-virtual-dtor -Wchar-subscripts -Wpointer-arith -Woverloaded-virtual -Wformat -Wformat-security -Werror=format-security -Wabi-tag -fpermissive -fstack-protector-all -pipe -fdata-sections -ffunction-sections -fsanitize-blacklist=${BLACKLIST} -flto -fsanitize=cfi -fsanitize-cfi-cross-dso -fno-sanitize-trap=all -fvisibility=default -D_GLIBCXX_USE_CXX11_ABI=1 -fPIE -fpie -fPIC -fpic -march=x86-64 -mno-avx -Wall -Wextra -Wshadow -pedantic -Wuseless-cast -Wno-c99-extensions -Wno-zero-length-array -Wno-unused-parameter -Wno-gnu-case-range"
 LINKARGS=" -fno-sanitize-trap=all -flto -fsanitize=cfi -fsanitize-cfi-cross-dso -fvisibility=default -D_GLIBCXX_USE_CXX11_ABI=1 -fsanitize-blacklist=${BLACKLIST}"
-LINKARGS2="-lboost_system-mt -lboost_filesystem-mt -lpthread -static-libstdc++"
+LINKARGS2="-lboost_system-mt -lboost_filesystem-mt -lpthread -ldl -static-libstdc++"
 
+${CC}  -I${BASE}/include -I. ${ARGS} -c -o broadcast.o broadcast.cpp
 ${CC}  -I${BASE}/include -I. ${ARGS} -c -o config.o config.cpp
+${CC}  -I${BASE}/include -I. ${ARGS} -c -o epoch.o epoch.cpp
+${CC}  -I${BASE}/include -I. ${ARGS} -c -o executor.o executor.cpp
+${CC}  -I${BASE}/include -I. ${ARGS} -c -o json_document.o json_document.cpp
+${CC}  -I${BASE}/include -I. ${ARGS} -c -o packs.o packs.cpp
+${CC}  -I${BASE}/include -I. ${ARGS} -c -o plugin_record.o plugin_record.cpp
+${CC}  -I${BASE}/include -I. ${ARGS} -c -o plugin_stats.o plugin_stats.cpp
+${CC}  -I${BASE}/include -I. ${ARGS} -c -o query_batch.o query_batch.cpp
+${CC}  -I${BASE}/include -I. ${ARGS} -c -o shm_transport.o shm_transport.cpp
+${CC}  -I${BASE}/include -I. ${ARGS} -c -o tables.o tables.cpp
 ${CC}  -I${BASE}/include -I. -Os ${ARGS} -c -o registry_Os.o registry.cpp
 ${CC}  -I${BASE}/include -I. -O0 ${ARGS} -c -o registry_O0.o registry.cpp
-${CC}  -L${BASE}/lib -I${BASE}/include -I. ${LINKARGS} -o cfi_Os config.o registry_Os.o ${LINKARGS2}
-${CC}  -L${BASE}/lib -I${BASE}/include -I. ${LINKARGS} -o cfi_O0 config.o registry_O0.o ${LINKARGS2}
+${CC}  -L${BASE}/lib -I${BASE}/include -I. ${LINKARGS} -o cfi_Os broadcast.o config.o epoch.o executor.o json_document.o packs.o plugin_record.o plugin_stats.o query_batch.o shm_transport.o tables.o registry_Os.o ${LINKARGS2}
+${CC}  -L${BASE}/lib -I${BASE}/include -I. ${LINKARGS} -o cfi_O0 broadcast.o config.o epoch.o executor.o json_document.o packs.o plugin_record.o plugin_stats.o query_batch.o shm_transport.o tables.o registry_O0.o ${LINKARGS2}
+
+# Registry benchmarks, linked without the registry's main.
+# See benchmarks/cfi_matrix.sh to compare CFI costs across build modes.
+${CC}  -I${BASE}/include -I. -O2 ${ARGS} -DOSQUERY_BENCHMARKS -c -o registry_bench.o registry.cpp
+${CC}  -I${BASE}/include -I. -O2 ${ARGS} -c -o registry_benchmarks.o benchmarks/registry_benchmarks.cpp
+${CC}  -I${BASE}/include -I. -O2 ${ARGS} -c -o plugin_record_benchmarks.o benchmarks/plugin_record_benchmarks.cpp
+${CC}  -I${BASE}/include -I. -O2 ${ARGS} -c -o registration_benchmarks.o benchmarks/registration_benchmarks.cpp
+${CC}  -I${BASE}/include -I. -O2 ${ARGS} -c -o cfi_dispatch_benchmarks.o benchmarks/cfi_dispatch_benchmarks.cpp
+${CC}  -I${BASE}/include -I. -O2 ${ARGS} -c -o broadcast_benchmarks.o benchmarks/broadcast_benchmarks.cpp
+${CC}  -I${BASE}/include -I. -O2 ${ARGS} -c -o plugin_stats_benchmarks.o benchmarks/plugin_stats_benchmarks.cpp
+${CC}  -I${BASE}/include -I. -O2 ${ARGS} -c -o async_call_benchmarks.o benchmarks/async_call_benchmarks.cpp
+${CC}  -I${BASE}/include -I. -O2 ${ARGS} -c -o shm_transport_benchmarks.o benchmarks/shm_transport_benchmarks.cpp
+${CC}  -I${BASE}/include -I. -O2 ${ARGS} -c -o lookup_benchmarks.o benchmarks/lookup_benchmarks.cpp
+${CC}  -L${BASE}/lib -I${BASE}/include -I. ${LINKARGS} -o cfi_benchmarks broadcast.o config.o epoch.o executor.o json_document.o packs.o plugin_record.o plugin_stats.o query_batch.o shm_transport.o tables.o registry_bench.o registry_benchmarks.o plugin_record_benchmarks.o registration_benchmarks.o cfi_dispatch_benchmarks.o broadcast_benchmarks.o plugin_stats_benchmarks.o async_call_benchmarks.o shm_transport_benchmarks.o lookup_benchmarks.o ${LINKARGS2} -lbenchmark -lbenchmark_main
+
+# Config parse benchmarks replace the global allocator to report peak heap use,
+# so they are linked on their own.
+${CC}  -I${BASE}/include -I. -O2 ${ARGS} -c -o config_benchmarks.o benchmarks/config_benchmarks.cpp
+${CC}  -L${BASE}/lib -I${BASE}/include -I. ${LINKARGS} -o config_benchmarks broadcast.o config.o epoch.o executor.o json_document.o packs.o plugin_record.o plugin_stats.o query_batch.o shm_transport.o tables.o registry_bench.o config_benchmarks.o ${LINKARGS2} -lbenchmark -lbenchmark_main
@@ -8,10 +8,16 @@
  *
  */
 
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <mutex>
 #include <random>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/trim.hpp>
 
@@ -108,10 +114,16 @@ class Schedule : private boost::noncopyable {
 
   /// Remove a pack by name and source.
   void remove(const std::string& pack, const std::string& source) {
+    packs_.remove_if([&pack, &source](const PackRef& p) {
+      return p->getName() == pack &&
+             (source.empty() || p->getSource() == source);
+    });
   }
 
   /// Remove all packs by source.
   void removeAll(const std::string& source) {
+    packs_.remove_if(
+        [&source](const PackRef& p) { return p->getSource() == source; });
   }
 
   /// Boost gives us a nice template for maintaining the state of the iterator
@@ -173,6 +185,14 @@ void Config::addPack(const std::string& name,
                      const pt::ptree& tree) {
 }
 
+void Config::addPack(const std::string& name,
+                     const std::string& source,
+                     const JSONValue& pack) {
+  auto ref = std::make_shared<Pack>(name, source, pack);
+  RecursiveLock lock(config_schedule_mutex_);
+  schedule_->add(std::move(ref));
+}
+
 void Config::removePack(const std::string& pack) {
 }
 
@@ -190,24 +210,288 @@ void Config::scheduledQueries(
 }
 
 void Config::packs(std::function<void(PackRef& pack)> predicate) {
+  RecursiveLock lock(config_schedule_mutex_);
+  for (PackRef& pack : schedule_->packs_) {
+    predicate(pack);
+  }
 }
 
 Status Config::load() {
-  return Status(1, "Missing config plugin ");
+  return Status(1, STATUS_LITERAL("Missing config plugin "));
+}
+
+namespace {
+
+/// Find the first of three bytes at or after pos, or size.
+inline size_t findAny(
+    const char* data, size_t pos, size_t size, char a, char b, char c) {
+  for (; pos < size; pos++) {
+    char x = data[pos];
+    if (x == a || x == b || x == c) {
+      return pos;
+    }
+  }
+  return size;
+}
+
+/// Move the kept bytes [in, end) down to out.
+inline void keepBytes(char* data, size_t& in, size_t& out, size_t end) {
+  // Nothing is moved until the first comment.
+  if (out != in) {
+    std::memmove(data + out, data + in, end - in);
+  }
+  out += end - in;
+  in = end;
+}
+
+void stripCommentsScalar(std::string& json) {
+  char* data = &json[0];
+  size_t size = json.size();
+  size_t in = 0;
+  size_t out = 0;
+
+  while (in < size) {
+    keepBytes(data, in, out, findAny(data, in, size, '"', '/', '#'));
+    if (in >= size) {
+      break;
+    }
+
+    char next = (in + 1 < size) ? data[in + 1] : '\0';
+    if (data[in] == '"') {
+      // Keep the string literal, an escaped quote does not end it.
+      auto pos = in + 1;
+      while (true) {
+        pos = findAny(data, pos, size, '"', '\\', '"');
+        if (pos >= size) {
+          break;
+        }
+        if (data[pos] == '"') {
+          pos++;
+          break;
+        }
+        pos += 2;
+      }
+      keepBytes(data, in, out, std::min(pos, size));
+    } else if (data[in] == '#' || next == '/') {
+      // Drop a line comment, keeping its newline.
+      in = findAny(data, in + 1, size, '\n', '\n', '\n');
+    } else if (next == '*') {
+      // Drop a block comment, an unterminated comment runs to the end.
+      auto pos = in + 2;
+      while (true) {
+        pos = findAny(data, pos, size, '*', '*', '*');
+        if (pos + 1 >= size) {
+          pos = size;
+          break;
+        }
+        if (data[pos + 1] == '/') {
+          pos += 2;
+          break;
+        }
+        pos++;
+      }
+      in = pos;
+    } else {
+      // A lone slash.
+      keepBytes(data, in, out, in + 1);
+    }
+  }
+  json.resize(out);
+}
+
+#ifdef __SSE2__
+/// True for the bytes that can change the comment scanner's state.
+inline bool isCommentSpecial(char x) {
+  return x == '"' || x == '\\' || x == '/' || x == '#' || x == '\n' ||
+         x == '*';
+}
+
+/**
+ * @brief Strip comments in one pass over 16-byte blocks.
+ *
+ * Each block is compared against every special byte once, and only the set
+ * bits of that mask are visited. Restarting a search per token costs more
+ * than it saves when strings and comments are short.
+ */
+void stripCommentsVectorized(std::string& json) {
+  enum class State { kJSON, kString, kLine, kBlock };
+
+  char* data = &json[0];
+  size_t size = json.size();
+  size_t in = 0;
+  size_t out = 0;
+  auto state = State::kJSON;
+
+  // Special bytes before skip were consumed with the byte before them.
+  size_t skip = 0;
+
+  const auto quote = _mm_set1_epi8('"');
+  const auto backslash = _mm_set1_epi8('\\');
+  const auto slash = _mm_set1_epi8('/');
+  const auto hash = _mm_set1_epi8('#');
+  const auto newline = _mm_set1_epi8('\n');
+  const auto star = _mm_set1_epi8('*');
+
+  for (size_t block = 0; block < size; block += 16) {
+    uint32_t mask = 0;
+    if (block + 16 <= size) {
+      auto bytes =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + block));
+      auto hits = _mm_or_si128(
+          _mm_or_si128(
+              _mm_or_si128(_mm_cmpeq_epi8(bytes, quote),
+                           _mm_cmpeq_epi8(bytes, backslash)),
+              _mm_or_si128(_mm_cmpeq_epi8(bytes, slash),
+                           _mm_cmpeq_epi8(bytes, hash))),
+          _mm_or_si128(_mm_cmpeq_epi8(bytes, newline),
+                       _mm_cmpeq_epi8(bytes, star)));
+      mask = static_cast<uint32_t>(_mm_movemask_epi8(hits));
+    } else {
+      for (size_t i = block; i < size; i++) {
+        if (isCommentSpecial(data[i])) {
+          mask |= 1U << (i - block);
+        }
+      }
+    }
+
+    for (; mask != 0; mask &= mask - 1) {
+      size_t pos = block + __builtin_ctz(mask);
+      if (pos < skip) {
+        continue;
+      }
+
+      char c = data[pos];
+      char next = (pos + 1 < size) ? data[pos + 1] : '\0';
+      switch (state) {
+      case State::kJSON:
+        if (c == '"') {
+          state = State::kString;
+        } else if (c == '#' || (c == '/' && next == '/')) {
+          keepBytes(data, in, out, pos);
+          state = State::kLine;
+        } else if (c == '/' && next == '*') {
+          keepBytes(data, in, out, pos);
+          skip = pos + 2;
+          state = State::kBlock;
+        }
+        break;
+      case State::kString:
+        // An escaped byte never ends the string literal.
+        if (c == '\\') {
+          skip = pos + 2;
+        } else if (c == '"') {
+          state = State::kJSON;
+        }
+        break;
+      case State::kLine:
+        // Drop the line comment, keeping its newline.
+        if (c == '\n') {
+          in = pos;
+          state = State::kJSON;
+        }
+        break;
+      case State::kBlock:
+        if (c == '*' && next == '/') {
+          in = pos + 2;
+          skip = pos + 2;
+          state = State::kJSON;
+        }
+        break;
+      }
+    }
+  }
+
+  // An unterminated comment runs to the end.
+  if (state == State::kJSON || state == State::kString) {
+    keepBytes(data, in, out, size);
+  }
+  json.resize(out);
+}
+#endif
 }
 
 void stripConfigComments(std::string& json) {
+#ifdef __SSE2__
+  stripCommentsVectorized(json);
+#else
+  stripCommentsScalar(json);
+#endif
+}
+
+void stripConfigCommentsScalar(std::string& json) {
+  stripCommentsScalar(json);
 }
 
 Status Config::updateSource(const std::string& source,
                             const std::string& json) {
-  return Status(0, "OK");
+  std::string content(json);
+  stripConfigComments(content);
+
+  JSONDocument document;
+  auto status = document.parse(std::move(content));
+  if (!status.ok()) {
+    return status;
+  }
+  auto tree = document.root();
+  if (!tree.isObject()) {
+    return Status(
+        1, STATUS_LITERAL("Config source is not a JSON object: "), source);
+  }
+
+  {
+    // The source replaces every pack it added before.
+    RecursiveLock lock(config_schedule_mutex_);
+    schedule_->removeAll(source);
+  }
+
+  // A source's top-level schedule is its main pack.
+  auto schedule = tree["schedule"];
+  if (schedule.isObject()) {
+    auto main = std::make_shared<Pack>("main", source, JSONValue());
+    main->addQueries(schedule);
+    RecursiveLock lock(config_schedule_mutex_);
+    schedule_->add(std::move(main));
+  }
+
+  for (const auto& pack : tree["packs"]) {
+    auto name = pack.getKey().to_string();
+    if (pack.isString()) {
+      // The pack content is a resource the config plugin retrieves.
+      auto pack_status = genPack(name, source, pack.asString());
+      if (!pack_status.ok()) {
+        // The remaining packs are still added, the source is reported.
+        status = pack_status;
+      }
+    } else if (pack.isObject()) {
+      addPack(name, source, pack);
+    }
+  }
+
+  applyParsers(source, tree, false);
+  return status;
 }
 
 Status Config::genPack(const std::string& name,
                        const std::string& source,
                        const std::string& target) {
-  return Status(0);
+  PluginResponse response;
+  auto status = RegistryFactory::call(
+      "config", {{"action", "genPack"}, {"name", name}, {"value", target}},
+      response);
+  if (!status.ok()) {
+    return status;
+  }
+
+  if (response.empty() || response[0].count(name) == 0) {
+    return Status(1, STATUS_LITERAL("No pack content: "), name);
+  }
+  JSONDocument document;
+  status = document.parse(std::move(response[0][name]));
+  if (!status.ok()) {
+    return status;
+  }
+  addPack(name, source, document.root());
+  return Status(0, "OK");
 }
 
 void Config::applyParsers(const std::string& source,
@@ -215,8 +499,35 @@ void Config::applyParsers(const std::string& source,
                           bool pack) {
 }
 
+void Config::applyParsers(const std::string& source,
+                          const JSONValue& tree,
+                          bool pack) {
+  for (const auto& name : RegistryFactory::get().names("config_parser")) {
+    auto parser = getParser(name);
+    if (parser == nullptr) {
+      continue;
+    }
+
+    ConfigParserPlugin::JSONParserConfig parser_config;
+    for (const auto& key : parser->keys()) {
+      parser_config[key] = tree[key];
+    }
+    parser->updateJSON(source, parser_config);
+  }
+}
+
 Status Config::update(const std::map<std::string, std::string>& config) {
-  return Status(0, "OK");
+  Status status;
+  for (const auto& source : config) {
+    auto source_status = updateSource(source.first, source.second);
+    if (!source_status.ok()) {
+      status = source_status;
+    }
+  }
+
+  WriteLock lock(config_valid_mutex_);
+  valid_ = status.ok();
+  return status;
 }
 
 void Config::purge() {
@@ -257,13 +568,9 @@ Status Config::genHash(std::string& hash) {
 
 const std::shared_ptr<ConfigParserPlugin> Config::getParser(
     const std::string& parser) {
-  if (!RegistryFactory::get().exists("config_parser", parser, true)) {
-    return nullptr;
-  }
-
-  auto plugin = RegistryFactory::get().plugin("config_parser", parser);
-  // This is an error, need to check for existance (and not nullptr).
-  return std::dynamic_pointer_cast<ConfigParserPlugin>(plugin);
+  // Items are type checked when added, this is not a dynamic cast.
+  return RegistryFactory::get().typedPlugin<ConfigParserPlugin>(
+      "config_parser", parser);
 }
 
 void Config::files(
@@ -274,12 +581,26 @@ void Config::files(
 Status ConfigPlugin::genPack(const std::string& name,
                              const std::string& value,
                              std::string& pack) {
-  return Status(1, "Not implemented");
+  return Status(1, STATUS_LITERAL("Not implemented"));
 }
 
 Status ConfigPlugin::call(const PluginRequest& request,
                           PluginResponse& response) {
-  return Status(1, "Config plugin action unknown: ");
+  return Status(1, STATUS_LITERAL("Config plugin action unknown: "));
+}
+
+Status ConfigPlugin::callRecord(const PluginRecord& request,
+                                PluginResponse& response) {
+  return Status(1, STATUS_LITERAL("Config plugin action unknown: "));
+}
+
+Status ConfigParserPlugin::updateJSON(const std::string& source,
+                                      const JSONParserConfig& config) {
+  ParserConfig trees;
+  for (const auto& key : config) {
+    toPtree(key.second, trees[key.first]);
+  }
+  return update(source, trees);
 }
 
 Status ConfigParserPlugin::setUp() {
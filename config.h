@@ -18,6 +18,7 @@
 #include <boost/iterator/filter_iterator.hpp>
 #include <boost/property_tree/ptree.hpp>
 
+#include <json_document.h>
 #include <registry.h>
 
 namespace osquery {
@@ -126,6 +127,11 @@ class Config : private boost::noncopyable {
                const std::string& source,
                const boost::property_tree::ptree& tree);
 
+  /// Add a pack to the osquery schedule from a parsed config document.
+  void addPack(const std::string& name,
+               const std::string& source,
+               const JSONValue& pack);
+
   /**
    * @brief Remove a pack from the osquery schedule
    */
@@ -230,7 +236,7 @@ class Config : private boost::noncopyable {
    */
   Status load();
 
-  /// A step method for Config::update.
+  /// A step method for Config::update, replaces the packs of the source.
   Status updateSource(const std::string& source, const std::string& json);
 
   /**
@@ -271,6 +277,16 @@ class Config : private boost::noncopyable {
                     const boost::property_tree::ptree& tree,
                     bool pack = false);
 
+  /**
+   * @brief Apply each ConfigParser to a parsed config document.
+   *
+   * Parsers receive views of their keys through ConfigParserPlugin::updateJSON,
+   * the document is not converted unless a parser only implements update.
+   */
+  void applyParsers(const std::string& source,
+                    const JSONValue& tree,
+                    bool pack = false);
+
   /**
    * @brief When config sources are updated the config will 'purge'.
    *
@@ -405,6 +421,8 @@ class ConfigPlugin : public Plugin {
 
   /// Main entrypoint for config plugin requests
   Status call(const PluginRequest& request, PluginResponse& response) override;
+  Status callRecord(const PluginRecord& request,
+                    PluginResponse& response) override;
 };
 
 /**
@@ -435,6 +453,9 @@ class ConfigParserPlugin : public Plugin {
  public:
   using ParserConfig = std::map<std::string, boost::property_tree::ptree>;
 
+  /// Views of each requested top-level key, missing if a source lacks it.
+  using JSONParserConfig = std::map<std::string, JSONValue>;
+
  public:
   /**
    * @brief Return a list of top-level config keys to receive in updates.
@@ -461,6 +482,21 @@ class ConfigParserPlugin : public Plugin {
   virtual Status update(const std::string& source,
                         const ParserConfig& config) = 0;
 
+  /**
+   * @brief Receive views of each top-level config key.
+   *
+   * This is what the Config calls. The views are only valid during the call.
+   * The default converts each view to a property tree and calls update, a
+   * parser reading large keys should override this to read the views
+   * directly.
+   *
+   * @param source source of the config data
+   * @param config Views into the parsed config document.
+   * @return Failure if the parser should no longer receive updates.
+   */
+  virtual Status updateJSON(const std::string& source,
+                            const JSONParserConfig& config);
+
   /// Allow parsers to perform some setup before the configuration is loaded.
   Status setUp() override;
 
@@ -468,6 +504,10 @@ class ConfigParserPlugin : public Plugin {
     return Status(0);
   }
 
+  Status callRecord(const PluginRecord&, PluginResponse&) override {
+    return Status(0);
+  }
+
   /**
    * @brief Accessor for parser-manipulated data.
    *
@@ -494,14 +534,17 @@ class ConfigParserPlugin : public Plugin {
 };
 
 /**
- * @brief Boost's 1.59 property tree based JSON parser does not accept comments.
+ * @brief JSON does not accept comments, strip them before parsing.
  *
- * For semi-compatibility with existing configurations we will attempt to strip
- * hash and C++ style comments. It is OK for the config update to be latent
- * as it is a single event. But some configuration plugins may update running
- * configurations.
+ * For semi-compatibility with existing configurations this removes hash and
+ * C++ style line comments, keeping the newline, and C style block comments.
+ * Comment characters within string literals are kept. The input is scanned
+ * once, 16 bytes at a time where SSE2 is available, and compacted in place.
  *
  * @parms json A mutable input/output string that will contain stripped JSON.
  */
 void stripConfigComments(std::string& json);
+
+/// The portable, byte at a time, stripConfigComments.
+void stripConfigCommentsScalar(std::string& json);
 }
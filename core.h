@@ -12,6 +12,7 @@
 
 #include <csignal>
 #include <memory>
+#include <mutex>
 #include <shared_mutex>
 #include <string>
 #include <vector>
@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <limits>
+
+#include <epoch.h>
+
+namespace osquery {
+
+constexpr size_t EpochDomain::kMaxReaders;
+constexpr size_t EpochDomain::kOverflowSlot;
+
+/// Per-thread reader state, the slot is released when the thread exits.
+struct EpochReader {
+  static constexpr size_t kNoSlot = std::numeric_limits<size_t>::max();
+
+  size_t slot{kNoSlot};
+  size_t depth{0};
+
+  ~EpochReader() {
+    if (slot != kNoSlot && slot != EpochDomain::kOverflowSlot) {
+      EpochDomain::get().slots_[slot].claimed.store(false,
+                                                    std::memory_order_release);
+    }
+  }
+};
+
+static EpochReader& getReader() {
+  static thread_local EpochReader reader;
+  return reader;
+}
+
+EpochDomain::~EpochDomain() {
+  for (const auto& retired : retired_) {
+    retired.deleter(retired.ptr);
+  }
+}
+
+size_t EpochDomain::claimSlot() {
+  for (size_t i = 0; i < kMaxReaders; i++) {
+    bool expected = false;
+    if (!slots_[i].claimed.load(std::memory_order_relaxed) &&
+        slots_[i].claimed.compare_exchange_strong(expected, true)) {
+      return i;
+    }
+  }
+  return kOverflowSlot;
+}
+
+void EpochDomain::enter() {
+  auto& reader = getReader();
+  if (reader.depth++ > 0) {
+    return;
+  }
+
+  if (reader.slot == EpochReader::kNoSlot ||
+      reader.slot == kOverflowSlot) {
+    reader.slot = claimSlot();
+  }
+
+  if (reader.slot == kOverflowSlot) {
+    overflow_readers_.fetch_add(1);
+  } else {
+    slots_[reader.slot].epoch.store(epoch_.load());
+  }
+  // Publish the observed epoch before any protected pointer is loaded.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void EpochDomain::exit() {
+  auto& reader = getReader();
+  if (--reader.depth > 0) {
+    return;
+  }
+
+  if (reader.slot == kOverflowSlot) {
+    overflow_readers_.fetch_sub(1, std::memory_order_release);
+  } else {
+    slots_[reader.slot].epoch.store(0, std::memory_order_release);
+  }
+}
+
+void EpochDomain::retire(void* ptr, void (*deleter)(void*)) {
+  // The replacement must be visible before the epoch advances.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  {
+    std::lock_guard<std::mutex> lock(retired_mutex_);
+    // Readers that entered at or before this epoch may still see ptr.
+    retired_.push_back({ptr, deleter, epoch_.fetch_add(1)});
+  }
+  reclaim();
+}
+
+void EpochDomain::reclaim() {
+  std::vector<Retired> freed;
+  {
+    std::lock_guard<std::mutex> lock(retired_mutex_);
+    if (retired_.empty() || overflow_readers_.load() > 0) {
+      return;
+    }
+
+    auto oldest = std::numeric_limits<uint64_t>::max();
+    for (const auto& slot : slots_) {
+      auto epoch = slot.epoch.load();
+      if (epoch != 0 && epoch < oldest) {
+        oldest = epoch;
+      }
+    }
+
+    auto it = retired_.begin();
+    while (it != retired_.end()) {
+      if (it->epoch < oldest) {
+        freed.push_back(*it);
+        it = retired_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  // Deleters run unlocked, they may retire or reclaim themselves.
+  for (const auto& retired : freed) {
+    retired.deleter(retired.ptr);
+  }
+}
+}
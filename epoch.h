@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+namespace osquery {
+
+/**
+ * @brief Epoch-based reclamation for read-mostly, copy-on-write state.
+ *
+ * Writers publish a new version of some structure through an atomic pointer
+ * and retire the old version. Readers wrap their access in an
+ * EpochDomain::ReadSection, which only stores the current epoch into a
+ * thread-owned, cache-line sized slot: no lock and no reference counting.
+ *
+ * A retired version is freed once every reader that could have observed it
+ * has left its read section.
+ */
+class EpochDomain : private boost::noncopyable {
+ public:
+  /// The process-wide domain, shared by all copy-on-write registry state.
+  static EpochDomain& get() {
+    static EpochDomain domain;
+    return domain;
+  }
+
+  /// RAII read-side critical section, nesting is allowed.
+  class ReadSection : private boost::noncopyable {
+   public:
+    ReadSection() {
+      EpochDomain::get().enter();
+    }
+
+    ~ReadSection() {
+      EpochDomain::get().exit();
+    }
+  };
+
+  /**
+   * @brief Retire an unpublished pointer, it is deleted when safe.
+   *
+   * The caller must have already replaced every published reference to ptr.
+   */
+  template <typename T>
+  void retire(const T* ptr) {
+    retire(const_cast<T*>(ptr), [](void* p) { delete static_cast<T*>(p); });
+  }
+
+  /// Free any retired pointers no reader can still observe.
+  void reclaim();
+
+ private:
+  EpochDomain() = default;
+  ~EpochDomain();
+
+  void enter();
+  void exit();
+  void retire(void* ptr, void (*deleter)(void*));
+
+  /// Claim a reader slot for the calling thread, or kOverflowSlot.
+  size_t claimSlot();
+
+ private:
+  /// Maximum number of concurrently reading threads with a private slot.
+  static constexpr size_t kMaxReaders = 256;
+
+  /// Readers beyond kMaxReaders share a counter that blocks reclamation.
+  static constexpr size_t kOverflowSlot = kMaxReaders;
+
+  struct alignas(64) ReaderSlot {
+    /// The epoch observed on entry, 0 while the owner is quiescent.
+    std::atomic<uint64_t> epoch{0};
+
+    /// Set while a thread owns this slot.
+    std::atomic<bool> claimed{false};
+  };
+
+  struct Retired {
+    void* ptr;
+    void (*deleter)(void*);
+    uint64_t epoch;
+  };
+
+  /// The global epoch, advanced on every retire.
+  std::atomic<uint64_t> epoch_{1};
+
+  ReaderSlot slots_[kMaxReaders];
+
+  /// Number of readers inside a section without a private slot.
+  std::atomic<size_t> overflow_readers_{0};
+
+  /// Retired pointers waiting for a grace period, protected by retired_mutex_.
+  std::vector<Retired> retired_;
+  std::mutex retired_mutex_;
+
+ private:
+  friend struct EpochReader;
+};
+}
@@ -0,0 +1,137 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <algorithm>
+
+#include <executor.h>
+
+namespace osquery {
+
+/// Keep a few workers on small hosts, plugins are often I/O bound.
+const size_t kMinExecutorThreads = 4;
+
+Executor& Executor::get() {
+  // Leaked, a static destructor joining the workers could hang exit.
+  static auto executor = new Executor(
+      std::max(kMinExecutorThreads,
+               static_cast<size_t>(std::thread::hardware_concurrency())));
+  return *executor;
+}
+
+Executor::Executor(size_t threads) {
+  for (size_t i = 0; i < threads; i++) {
+    threads_.emplace_back([this]() { work(); });
+  }
+}
+
+void Executor::submit(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  condition_.notify_one();
+}
+
+bool Executor::runOne() {
+  Task task;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (tasks_.empty()) {
+      return false;
+    }
+    task = std::move(tasks_.front());
+    tasks_.pop_front();
+  }
+  task();
+  return true;
+}
+
+void Executor::work() {
+  while (true) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition_.wait(lock, [this]() { return !tasks_.empty(); });
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+
+    try {
+      task();
+    } catch (...) {
+      // A throwing task must not take its worker, and the process, down.
+    }
+  }
+}
+
+bool TaskGroup::execute(State& state, Work& work) {
+  bool expected = false;
+  if (!work.claimed.compare_exchange_strong(expected, true)) {
+    return false;
+  }
+
+  std::exception_ptr error;
+  try {
+    work.task();
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (error != nullptr && state.error == nullptr) {
+    state.error = std::move(error);
+  }
+  state.pending--;
+  state.condition.notify_all();
+  return true;
+}
+
+void TaskGroup::run(Executor::Task task) {
+  auto work = std::make_shared<Work>();
+  work->task = std::move(task);
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    work_.push_back(work);
+    state_->pending++;
+  }
+  // The queued closure keeps the work and state alive, not the group, which
+  // may be destroyed before a worker pops the closure and fails to claim it.
+  auto state = state_;
+  Executor::get().submit([state, work]() { execute(*state, *work); });
+}
+
+void TaskGroup::wait() {
+  auto error = drain();
+  if (error != nullptr) {
+    std::rethrow_exception(error);
+  }
+}
+
+std::exception_ptr TaskGroup::drain() {
+  auto& state = *state_;
+  auto done = [&state]() { return state.pending == 0; };
+  std::unique_lock<std::mutex> lock(state.mutex);
+  std::vector<std::shared_ptr<Work>> work;
+  work.swap(work_);
+  if (!state.condition.wait_for(lock, kTaskGroupInlineDelay, done)) {
+    // The workers are busy, run anything not yet started, newest first.
+    lock.unlock();
+    for (auto it = work.rbegin(); it != work.rend(); ++it) {
+      execute(state, **it);
+    }
+    lock.lock();
+    state.condition.wait(lock, done);
+  }
+
+  std::exception_ptr error;
+  error.swap(state.error);
+  return error;
+}
+}
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+namespace osquery {
+
+/**
+ * @brief A fixed-size worker pool shared by the registry.
+ *
+ * The executor is used for work that should not serialize on the calling
+ * thread, such as fanning a call out to several plugins. Threads are started
+ * on first use and run for the life of the process: the executor is never
+ * destroyed, so exit does not wait on a worker stuck in a task, such as a
+ * timed out plugin setUp.
+ */
+class Executor : private boost::noncopyable {
+ public:
+  using Task = std::function<void()>;
+
+  /// The process-wide executor.
+  static Executor& get();
+
+  /// Queue a task for any worker.
+  void submit(Task task);
+
+  /// Run one queued task on the calling thread, false if none was queued.
+  bool runOne();
+
+  /// Number of worker threads.
+  size_t size() const {
+    return threads_.size();
+  }
+
+ private:
+  explicit Executor(size_t threads);
+
+  void work();
+
+ private:
+  std::vector<std::thread> threads_;
+  std::deque<Task> tasks_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+};
+
+/**
+ * @brief A set of tasks the caller waits on.
+ *
+ * Tasks are queued to the Executor, but each may run at most once: if the
+ * waiting thread finds a task still queued it claims and runs it inline.
+ * A group waited on from a worker can therefore never deadlock the pool,
+ * and the caller's thread always contributes instead of sleeping.
+ *
+ * A task that throws still completes, the first exception is rethrown by
+ * wait() once every task has finished.
+ */
+/// How long TaskGroup::wait leaves queued tasks to the workers.
+const auto kTaskGroupInlineDelay = std::chrono::milliseconds(1);
+
+class TaskGroup : private boost::noncopyable {
+ public:
+  TaskGroup() = default;
+
+  /// Waits for outstanding tasks, an exception from a task is discarded.
+  ~TaskGroup() {
+    drain();
+  }
+
+  /// Add a task, it starts as soon as a worker is free.
+  void run(Executor::Task task);
+
+  /**
+   * @brief Wait for every task, running any still unclaimed inline.
+   *
+   * Workers get kTaskGroupInlineDelay to claim the tasks, so they run in
+   * parallel; a task is only run by the waiter once the workers are busy.
+   * Rethrows the first exception a task raised since the last wait.
+   */
+  void wait();
+
+ private:
+  struct Work {
+    Executor::Task task;
+    std::atomic<bool> claimed{false};
+  };
+
+  /// Completion state, shared with queued tasks that may outlive the group.
+  struct State {
+    size_t pending{0};
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable condition;
+  };
+
+  /// Claim and run a task, false if another thread claimed it first.
+  static bool execute(State& state, Work& work);
+
+  /// Wait for every task, returning the first exception raised.
+  std::exception_ptr drain();
+
+ private:
+  std::vector<std::shared_ptr<Work>> work_;
+  std::shared_ptr<State> state_{std::make_shared<State>()};
+};
+}
@@ -0,0 +1,175 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/utility/string_ref.hpp>
+
+namespace osquery {
+
+/// Hash a registry or item name, FNV-1a is cheap for short identifiers.
+inline uint64_t hashName(boost::string_ref name) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const auto c : name) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ULL;
+  }
+  // A zero hash marks an empty slot.
+  return (hash == 0) ? 1 : hash;
+}
+
+/**
+ * @brief An open-addressing string-keyed index.
+ *
+ * The registry keeps its ordered std::map tables for iteration and
+ * introspection, this index sits beside them and answers the hot-path
+ * "does this name exist, and where is it" question with a single linear probe.
+ *
+ * Probing only touches the contiguous hash array until a candidate matches,
+ * and lookups accept a boost::string_ref so callers holding a literal or a
+ * slice of a larger buffer do not need to build a temporary std::string.
+ */
+template <typename Value>
+class FlatIndex {
+ public:
+  FlatIndex() = default;
+
+  /// Find the value for a key, nullptr if the key is not indexed.
+  Value* find(boost::string_ref key) {
+    auto slot = probe(key, hashName(key));
+    return (slot < hashes_.size() && hashes_[slot] != 0)
+               ? &entries_[slot].second
+               : nullptr;
+  }
+
+  const Value* find(boost::string_ref key) const {
+    return const_cast<FlatIndex*>(this)->find(key);
+  }
+
+  /**
+   * @brief Find or default-construct the value for a key.
+   *
+   * Only inserting a new key may grow the table, updating an existing key's
+   * value never moves entries.
+   */
+  Value& operator[](boost::string_ref key) {
+    auto hash = hashName(key);
+    auto slot = probe(key, hash);
+    if (slot < hashes_.size() && hashes_[slot] != 0) {
+      return entries_[slot].second;
+    }
+
+    if ((size_ + 1) * 2 > hashes_.size()) {
+      rehash((hashes_.empty()) ? kMinCapacity : hashes_.size() * 2);
+      slot = probe(key, hash);
+    }
+    hashes_[slot] = hash;
+    entries_[slot].first.assign(key.data(), key.size());
+    size_++;
+    return entries_[slot].second;
+  }
+
+  /// Remove a key, returns false if the key was not indexed.
+  bool erase(boost::string_ref key) {
+    auto slot = probe(key, hashName(key));
+    if (slot >= hashes_.size() || hashes_[slot] == 0) {
+      return false;
+    }
+
+    // Backward-shift deletion keeps probe sequences tombstone-free.
+    auto mask = hashes_.size() - 1;
+    auto hole = slot;
+    for (auto next = (hole + 1) & mask; hashes_[next] != 0;
+         next = (next + 1) & mask) {
+      auto desired = hashes_[next] & mask;
+      bool movable = (hole <= next) ? (desired <= hole || desired > next)
+                                    : (desired <= hole && desired > next);
+      if (movable) {
+        hashes_[hole] = hashes_[next];
+        entries_[hole] = std::move(entries_[next]);
+        hole = next;
+      }
+    }
+    hashes_[hole] = 0;
+    entries_[hole] = Entry();
+    size_--;
+    return true;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  void clear() {
+    hashes_.clear();
+    entries_.clear();
+    size_ = 0;
+  }
+
+ private:
+  using Entry = std::pair<std::string, Value>;
+
+  /// Return the slot holding key, or the empty slot where it would be placed.
+  size_t probe(boost::string_ref key, uint64_t hash) const {
+    if (hashes_.empty()) {
+      return 0;
+    }
+
+    auto mask = hashes_.size() - 1;
+    for (auto slot = hash & mask;; slot = (slot + 1) & mask) {
+      if (hashes_[slot] == 0 ||
+          (hashes_[slot] == hash && key == entries_[slot].first)) {
+        return slot;
+      }
+    }
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<uint64_t> hashes(capacity, 0);
+    std::vector<Entry> entries(capacity);
+    auto mask = capacity - 1;
+    for (size_t i = 0; i < hashes_.size(); i++) {
+      if (hashes_[i] == 0) {
+        continue;
+      }
+
+      auto slot = hashes_[i] & mask;
+      while (hashes[slot] != 0) {
+        slot = (slot + 1) & mask;
+      }
+      hashes[slot] = hashes_[i];
+      entries[slot] = std::move(entries_[i]);
+    }
+    hashes_.swap(hashes);
+    entries_.swap(entries);
+  }
+
+ private:
+  /// Capacity is always a power of two, so probing can mask.
+  static constexpr size_t kMinCapacity = 16;
+
+  /// Slot hashes, 0 is an empty slot. Kept apart from keys for dense probing.
+  std::vector<uint64_t> hashes_;
+
+  /// Slot keys and values, parallel to hashes_.
+  std::vector<Entry> entries_;
+
+  /// Number of occupied slots.
+  size_t size_{0};
+};
+
+template <typename Value>
+constexpr size_t FlatIndex<Value>::kMinCapacity;
+}
@@ -0,0 +1,515 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include <json_document.h>
+
+namespace pt = boost::property_tree;
+
+namespace osquery {
+
+namespace {
+
+/// Documents index their text and nodes with 32-bit offsets.
+const size_t kMaxDocumentSize = std::numeric_limits<uint32_t>::max();
+
+inline bool isSpace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+inline int hexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+/// Read the 4 hex digits of a \u escape.
+inline bool readHex4(const char* in, uint32_t& code) {
+  code = 0;
+  for (size_t i = 0; i < 4; i++) {
+    auto digit = hexValue(in[i]);
+    if (digit < 0) {
+      return false;
+    }
+    code = (code << 4) | static_cast<uint32_t>(digit);
+  }
+  return true;
+}
+
+/// Write a code point as UTF-8, returning the bytes written.
+inline size_t writeUTF8(uint32_t code, char* out) {
+  if (code < 0x80) {
+    out[0] = static_cast<char>(code);
+    return 1;
+  }
+  if (code < 0x800) {
+    out[0] = static_cast<char>(0xC0 | (code >> 6));
+    out[1] = static_cast<char>(0x80 | (code & 0x3F));
+    return 2;
+  }
+  if (code < 0x10000) {
+    out[0] = static_cast<char>(0xE0 | (code >> 12));
+    out[1] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+    out[2] = static_cast<char>(0x80 | (code & 0x3F));
+    return 3;
+  }
+  out[0] = static_cast<char>(0xF0 | (code >> 18));
+  out[1] = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+  out[2] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+  out[3] = static_cast<char>(0x80 | (code & 0x3F));
+  return 4;
+}
+
+/// Copy a numeric text to a NUL-terminated buffer for strtod and friends.
+inline bool copyNumeric(boost::string_ref text, char* out, size_t size) {
+  if (text.empty() || text.size() >= size) {
+    return false;
+  }
+  std::memcpy(out, text.data(), text.size());
+  out[text.size()] = '\0';
+  return true;
+}
+}
+
+JSONType JSONValue::getType() const {
+  return (document_ == nullptr) ? JSONType::kMissing
+                                : document_->nodes_[index_].type;
+}
+
+size_t JSONValue::size() const {
+  auto type = getType();
+  if (type != JSONType::kArray && type != JSONType::kObject) {
+    return 0;
+  }
+  return document_->nodes_[index_].length;
+}
+
+boost::string_ref JSONValue::getKey() const {
+  if (document_ == nullptr) {
+    return boost::string_ref();
+  }
+  const auto& node = document_->nodes_[index_];
+  return boost::string_ref(document_->buffer_.data() + node.key_offset,
+                           node.key_length);
+}
+
+boost::string_ref JSONValue::getText() const {
+  auto type = getType();
+  if (type == JSONType::kMissing || type == JSONType::kArray ||
+      type == JSONType::kObject) {
+    return boost::string_ref();
+  }
+  const auto& node = document_->nodes_[index_];
+  return boost::string_ref(document_->buffer_.data() + node.offset,
+                           node.length);
+}
+
+bool JSONValue::getBool(bool fallback) const {
+  auto type = getType();
+  if (type == JSONType::kTrue || type == JSONType::kFalse) {
+    return type == JSONType::kTrue;
+  }
+  if (type == JSONType::kString) {
+    auto text = getText();
+    if (text == "true") {
+      return true;
+    } else if (text == "false") {
+      return false;
+    }
+  }
+  return fallback;
+}
+
+uint64_t JSONValue::getUInt(uint64_t fallback) const {
+  auto type = getType();
+  if (type != JSONType::kNumber && type != JSONType::kString) {
+    return fallback;
+  }
+  char digits[32];
+  if (!copyNumeric(getText(), digits, sizeof(digits)) || digits[0] == '-') {
+    return fallback;
+  }
+  char* end = nullptr;
+  errno = 0;
+  auto value = std::strtoull(digits, &end, 10);
+  return (*end != '\0' || errno != 0) ? fallback : value;
+}
+
+int64_t JSONValue::getInt(int64_t fallback) const {
+  auto type = getType();
+  if (type != JSONType::kNumber && type != JSONType::kString) {
+    return fallback;
+  }
+  char digits[32];
+  if (!copyNumeric(getText(), digits, sizeof(digits))) {
+    return fallback;
+  }
+  char* end = nullptr;
+  errno = 0;
+  auto value = std::strtoll(digits, &end, 10);
+  return (*end != '\0' || errno != 0) ? fallback : value;
+}
+
+double JSONValue::getDouble(double fallback) const {
+  auto type = getType();
+  if (type != JSONType::kNumber && type != JSONType::kString) {
+    return fallback;
+  }
+  char digits[64];
+  if (!copyNumeric(getText(), digits, sizeof(digits))) {
+    return fallback;
+  }
+  char* end = nullptr;
+  auto value = std::strtod(digits, &end);
+  return (*end != '\0') ? fallback : value;
+}
+
+JSONValue JSONValue::operator[](boost::string_ref key) const {
+  if (getType() != JSONType::kObject) {
+    return JSONValue();
+  }
+
+  // The first of repeated members, as property_tree's get_child finds.
+  for (auto it = begin(); it != end(); ++it) {
+    if (it->getKey() == key) {
+      return *it;
+    }
+  }
+  return JSONValue();
+}
+
+JSONValue JSONValue::at(size_t i) const {
+  if (getType() != JSONType::kArray || i >= size()) {
+    return JSONValue();
+  }
+  auto it = begin();
+  while (i-- > 0) {
+    ++it;
+  }
+  return *it;
+}
+
+JSONValue::const_iterator& JSONValue::const_iterator::operator++() {
+  value_.index_ = value_.document_->nodes_[value_.index_].next;
+  return *this;
+}
+
+JSONValue::const_iterator JSONValue::begin() const {
+  auto type = getType();
+  if (type != JSONType::kArray && type != JSONType::kObject) {
+    return end();
+  }
+  return const_iterator(document_, index_ + 1);
+}
+
+JSONValue::const_iterator JSONValue::end() const {
+  if (document_ == nullptr) {
+    return const_iterator(nullptr, 0);
+  }
+  return const_iterator(document_, document_->nodes_[index_].next);
+}
+
+bool JSONDocument::parseString(size_t& pos, uint32_t& offset, uint32_t& length) {
+  char* data = &buffer_[0];
+  size_t size = buffer_.size();
+  size_t out = pos;
+  offset = static_cast<uint32_t>(pos);
+
+  while (pos < size) {
+    // Copy the unescaped run, most strings have no escapes at all.
+    auto run = pos;
+    while (run < size && data[run] != '"' && data[run] != '\\' &&
+           static_cast<unsigned char>(data[run]) >= 0x20) {
+      run++;
+    }
+    if (out != pos) {
+      std::memmove(data + out, data + pos, run - pos);
+    }
+    out += run - pos;
+    pos = run;
+    if (pos >= size) {
+      return false;
+    }
+
+    char c = data[pos];
+    if (c == '"') {
+      pos++;
+      length = static_cast<uint32_t>(out - offset);
+      return true;
+    } else if (c != '\\' || pos + 1 >= size) {
+      // Control characters must be escaped.
+      return false;
+    }
+
+    // The decoded escape is never longer than the escape sequence.
+    char escape = data[pos + 1];
+    pos += 2;
+    switch (escape) {
+    case '"':
+    case '\\':
+    case '/':
+      data[out++] = escape;
+      break;
+    case 'b':
+      data[out++] = '\b';
+      break;
+    case 'f':
+      data[out++] = '\f';
+      break;
+    case 'n':
+      data[out++] = '\n';
+      break;
+    case 'r':
+      data[out++] = '\r';
+      break;
+    case 't':
+      data[out++] = '\t';
+      break;
+    case 'u': {
+      uint32_t code = 0;
+      if (pos + 4 > size || !readHex4(data + pos, code)) {
+        return false;
+      }
+      pos += 4;
+      if (code >= 0xD800 && code <= 0xDBFF) {
+        uint32_t low = 0;
+        if (pos + 6 > size || data[pos] != '\\' || data[pos + 1] != 'u' ||
+            !readHex4(data + pos + 2, low) || low < 0xDC00 || low > 0xDFFF) {
+          return false;
+        }
+        pos += 6;
+        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+      } else if (code >= 0xDC00 && code <= 0xDFFF) {
+        return false;
+      }
+      out += writeUTF8(code, data + out);
+      break;
+    }
+    default:
+      return false;
+    }
+  }
+  return false;
+}
+
+bool JSONDocument::parseNumber(size_t& pos) {
+  const char* data = buffer_.data();
+  size_t size = buffer_.size();
+
+  if (pos < size && data[pos] == '-') {
+    pos++;
+  }
+  if (pos >= size || !isDigit(data[pos])) {
+    return false;
+  }
+  if (data[pos] == '0') {
+    pos++;
+  } else {
+    while (pos < size && isDigit(data[pos])) {
+      pos++;
+    }
+  }
+  if (pos < size && data[pos] == '.') {
+    pos++;
+    if (pos >= size || !isDigit(data[pos])) {
+      return false;
+    }
+    while (pos < size && isDigit(data[pos])) {
+      pos++;
+    }
+  }
+  if (pos < size && (data[pos] == 'e' || data[pos] == 'E')) {
+    pos++;
+    if (pos < size && (data[pos] == '+' || data[pos] == '-')) {
+      pos++;
+    }
+    if (pos >= size || !isDigit(data[pos])) {
+      return false;
+    }
+    while (pos < size && isDigit(data[pos])) {
+      pos++;
+    }
+  }
+  return true;
+}
+
+Status JSONDocument::parse(std::string json) {
+  buffer_ = std::move(json);
+  nodes_.clear();
+  if (buffer_.size() >= kMaxDocumentSize) {
+    buffer_.clear();
+    return Status(1, STATUS_LITERAL("JSON document is too large"));
+  }
+
+  // Most values in a config are short, this avoids regrowing the node array.
+  nodes_.reserve(buffer_.size() / 32 + 1);
+
+  const char* data = buffer_.data();
+  size_t size = buffer_.size();
+  size_t pos = 0;
+
+  // The open containers, innermost last.
+  std::vector<uint32_t> open;
+
+  // The member name for the next value, if within an object.
+  uint32_t key_offset = 0;
+  uint32_t key_length = 0;
+
+  auto error = [this, &pos]() {
+    nodes_.clear();
+    return Status(
+        1, STATUS_LITERAL("JSON parse error at offset "), std::to_string(pos));
+  };
+  auto skip = [data, size, &pos]() {
+    while (pos < size && isSpace(data[pos])) {
+      pos++;
+    }
+  };
+  auto literal = [data, size, &pos](const char* text, size_t length) {
+    if (size - pos < length || std::memcmp(data + pos, text, length) != 0) {
+      return false;
+    }
+    pos += length;
+    return true;
+  };
+
+  skip();
+  while (true) {
+    // Parse one value, its member name, if any, was read already.
+    if (pos >= size) {
+      return error();
+    }
+
+    nodes_.emplace_back();
+    auto index = static_cast<uint32_t>(nodes_.size() - 1);
+    nodes_[index].key_offset = key_offset;
+    nodes_[index].key_length = key_length;
+
+    bool container = false;
+    auto value_start = pos;
+    char c = data[pos];
+    if (c == '{' || c == '[') {
+      nodes_[index].type = (c == '{') ? JSONType::kObject : JSONType::kArray;
+      open.push_back(index);
+      container = true;
+      pos++;
+    } else if (c == '"') {
+      pos++;
+      if (!parseString(pos, nodes_[index].offset, nodes_[index].length)) {
+        return error();
+      }
+      nodes_[index].type = JSONType::kString;
+    } else if (c == 't' || c == 'f' || c == 'n') {
+      if (literal("true", 4)) {
+        nodes_[index].type = JSONType::kTrue;
+      } else if (literal("false", 5)) {
+        nodes_[index].type = JSONType::kFalse;
+      } else if (literal("null", 4)) {
+        nodes_[index].type = JSONType::kNull;
+      } else {
+        return error();
+      }
+    } else {
+      if (!parseNumber(pos)) {
+        return error();
+      }
+      nodes_[index].type = JSONType::kNumber;
+    }
+
+    if (!container) {
+      if (nodes_[index].type != JSONType::kString) {
+        nodes_[index].offset = static_cast<uint32_t>(value_start);
+        nodes_[index].length = static_cast<uint32_t>(pos - value_start);
+      }
+      nodes_[index].next = index + 1;
+    }
+
+    // Close containers, then find the next value's position and member name.
+    bool first = container;
+    while (true) {
+      skip();
+      if (open.empty()) {
+        if (pos != size) {
+          return error();
+        }
+        return Status(0, "OK");
+      }
+
+      auto& parent = nodes_[open.back()];
+      char close = (parent.type == JSONType::kObject) ? '}' : ']';
+      if (pos < size && data[pos] == close) {
+        pos++;
+        parent.next = static_cast<uint32_t>(nodes_.size());
+        open.pop_back();
+        first = false;
+        continue;
+      }
+
+      if (!first) {
+        if (pos >= size || data[pos] != ',') {
+          return error();
+        }
+        pos++;
+        skip();
+      }
+      parent.length++;
+
+      if (parent.type == JSONType::kObject) {
+        if (pos >= size || data[pos] != '"') {
+          return error();
+        }
+        pos++;
+        if (!parseString(pos, key_offset, key_length)) {
+          return error();
+        }
+        skip();
+        if (pos >= size || data[pos] != ':') {
+          return error();
+        }
+        pos++;
+      } else {
+        key_offset = 0;
+        key_length = 0;
+      }
+      skip();
+      break;
+    }
+  }
+}
+
+void toPtree(const JSONValue& value, pt::ptree& tree) {
+  if (value.isObject() || value.isArray()) {
+    for (const auto& child : value) {
+      pt::ptree subtree;
+      toPtree(child, subtree);
+      tree.push_back(std::make_pair(
+          (value.isObject()) ? child.getKey().to_string() : std::string(),
+          std::move(subtree)));
+    }
+  } else if (value.exists()) {
+    tree.put_value(value.asString());
+  }
+}
+}
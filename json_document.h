@@ -0,0 +1,249 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include <status.h>
+
+namespace osquery {
+
+class JSONDocument;
+
+/// The JSON value types.
+enum class JSONType : uint8_t {
+  kMissing,
+  kNull,
+  kFalse,
+  kTrue,
+  kNumber,
+  kString,
+  kArray,
+  kObject,
+};
+
+/**
+ * @brief A read-only view of a value within a JSONDocument.
+ *
+ * Views are two words and are passed by value. A view into a document is
+ * valid for the life of the document. Looking up a member or element that
+ * does not exist returns a missing view, so lookups may be chained:
+ *
+ * @code{.cpp}
+ *   auto interval = root["schedule"]["processes"]["interval"].getUInt(3600);
+ * @endcode
+ */
+class JSONValue {
+ public:
+  /// A missing value.
+  JSONValue() : document_(nullptr), index_(0) {}
+
+  JSONType getType() const;
+
+  bool exists() const {
+    return getType() != JSONType::kMissing;
+  }
+
+  bool isNull() const {
+    return getType() == JSONType::kNull;
+  }
+
+  bool isBool() const {
+    return getType() == JSONType::kTrue || getType() == JSONType::kFalse;
+  }
+
+  bool isNumber() const {
+    return getType() == JSONType::kNumber;
+  }
+
+  bool isString() const {
+    return getType() == JSONType::kString;
+  }
+
+  bool isArray() const {
+    return getType() == JSONType::kArray;
+  }
+
+  bool isObject() const {
+    return getType() == JSONType::kObject;
+  }
+
+  /// The number of members or elements, 0 for scalars.
+  size_t size() const;
+
+  /// The member name, if this value was reached through an object.
+  boost::string_ref getKey() const;
+
+  /**
+   * @brief The value's text without a copy.
+   *
+   * Strings are decoded, numbers and literals are their JSON text. Containers
+   * and missing values are empty.
+   */
+  boost::string_ref getText() const;
+
+  /// Copy the value's text, as a property tree would store it.
+  std::string asString() const {
+    auto text = getText();
+    return std::string(text.data(), text.size());
+  }
+
+  /// A boolean, or a "true"/"false" string, otherwise the fallback.
+  bool getBool(bool fallback = false) const;
+
+  /// A non-negative integer number or numeric string, otherwise the fallback.
+  uint64_t getUInt(uint64_t fallback = 0) const;
+
+  /// An integer number or numeric string, otherwise the fallback.
+  int64_t getInt(int64_t fallback = 0) const;
+
+  /// A number or numeric string, otherwise the fallback.
+  double getDouble(double fallback = 0) const;
+
+  /// An object's member, the first if a name repeats, or a missing value.
+  JSONValue operator[](boost::string_ref key) const;
+
+  /// An array's element, or a missing value.
+  JSONValue at(size_t i) const;
+
+  /// Iterates an object's members or an array's elements.
+  class const_iterator;
+
+  const_iterator begin() const;
+  const_iterator end() const;
+
+ private:
+  JSONValue(const JSONDocument* document, uint32_t index)
+      : document_(document), index_(index) {}
+
+ private:
+  const JSONDocument* document_;
+  uint32_t index_;
+
+ private:
+  friend class JSONDocument;
+};
+
+/// A forward iterator over a container value's children.
+class JSONValue::const_iterator {
+ public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = JSONValue;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const JSONValue*;
+  using reference = const JSONValue&;
+
+  const_iterator(const JSONDocument* document, uint32_t index)
+      : value_(document, index) {}
+
+  reference operator*() const {
+    return value_;
+  }
+
+  pointer operator->() const {
+    return &value_;
+  }
+
+  const_iterator& operator++();
+
+  bool operator==(const const_iterator& rhs) const {
+    return value_.index_ == rhs.value_.index_;
+  }
+
+  bool operator!=(const const_iterator& rhs) const {
+    return !operator==(rhs);
+  }
+
+ private:
+  JSONValue value_;
+};
+
+/**
+ * @brief A compact, read-only JSON document.
+ *
+ * The parser is iterative and makes a single pass over the input. The input
+ * string is kept by the document and strings are decoded within it, so a
+ * string value is a view rather than a copy. Every value is one fixed-size
+ * node in a flat array, ordered as in the input. Containers record where
+ * their subtree ends, so siblings are found without walking children.
+ *
+ * A multi-megabyte config is then a few allocations rather than a node, key,
+ * and value string per element as with boost::property_tree.
+ */
+class JSONDocument : private boost::noncopyable {
+ public:
+  JSONDocument() = default;
+
+  /// Parse a JSON text, replacing any previous content.
+  Status parse(std::string json);
+
+  /// The top-level value, missing if nothing was parsed.
+  JSONValue root() const {
+    return (nodes_.empty()) ? JSONValue() : JSONValue(this, 0);
+  }
+
+  /// The number of JSON values in the document.
+  size_t count() const {
+    return nodes_.size();
+  }
+
+  /// Bytes held by the document, its text and node array.
+  size_t memoryUsage() const {
+    return buffer_.capacity() + nodes_.capacity() * sizeof(Node);
+  }
+
+ private:
+  struct Node {
+    /// The member name, offset and length within buffer_.
+    uint32_t key_offset{0};
+    uint32_t key_length{0};
+
+    /// Scalar text within buffer_, or a container's member count.
+    uint32_t offset{0};
+    uint32_t length{0};
+
+    /// The index following this value's subtree.
+    uint32_t next{0};
+
+    JSONType type{JSONType::kMissing};
+  };
+
+  /// Decode the string starting after the quote at pos, in place.
+  bool parseString(size_t& pos, uint32_t& offset, uint32_t& length);
+
+  /// Check the number grammar starting at pos.
+  bool parseNumber(size_t& pos);
+
+ private:
+  /// The parsed text, strings are decoded in place.
+  std::string buffer_;
+
+  std::vector<Node> nodes_;
+
+ private:
+  friend class JSONValue;
+};
+
+/**
+ * @brief Copy a value into a property tree, as read_json would build it.
+ *
+ * This adapts a document for code written against boost::property_tree,
+ * such as ConfigParserPlugin::update.
+ */
+void toPtree(const JSONValue& value, boost::property_tree::ptree& tree);
+}
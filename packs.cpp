@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <core.h>
+#include <packs.h>
+
+namespace osquery {
+
+/// The longest allowed query interval, one week in seconds.
+const size_t kMaxQueryInterval = 604800;
+
+void Pack::initialize(const std::string& name,
+                      const std::string& source,
+                      const JSONValue& pack) {
+  name_ = name;
+  source_ = source;
+
+  discovery_queries_.clear();
+  for (const auto& query : pack["discovery"]) {
+    if (query.isString()) {
+      discovery_queries_.push_back(query.asString());
+    }
+  }
+
+  platform_ = pack["platform"].asString();
+  version_ = pack["version"].asString();
+
+  // Shards are percentages of hosts, 0 means every host.
+  auto shard = pack["shard"].getUInt(0);
+  shard_ = (shard <= 100) ? static_cast<size_t>(shard) : 0;
+
+  schedule_.clear();
+  addQueries(pack["queries"]);
+}
+
+void Pack::addQueries(const JSONValue& queries) {
+  for (const auto& item : queries) {
+    auto interval = item["interval"].getUInt(0);
+    if (interval == 0 || interval > kMaxQueryInterval) {
+      continue;
+    }
+
+    ScheduledQuery query;
+    query.query = item["query"].asString();
+    query.interval = static_cast<size_t>(interval);
+    query.splayed_interval = query.interval;
+    query.options["snapshot"] = item["snapshot"].getBool(false);
+    query.options["removed"] = item["removed"].getBool(true);
+    schedule_[item.getKey().to_string()] = std::move(query);
+  }
+}
+
+const std::vector<std::string>& Pack::getDiscoveryQueries() const {
+  return discovery_queries_;
+}
+
+void Pack::setName(const std::string& name) {
+  name_ = name;
+}
+
+const std::string& Pack::getName() const {
+  return name_;
+}
+
+const std::string& Pack::getSource() const {
+  return source_;
+}
+
+const std::string& Pack::getPlatform() const {
+  return platform_;
+}
+
+const std::string& Pack::getVersion() const {
+  return version_;
+}
+
+const std::map<std::string, ScheduledQuery>& Pack::getSchedule() const {
+  return schedule_;
+}
+
+const PackStats& Pack::getStats() const {
+  return stats_;
+}
+}
@@ -18,6 +18,7 @@
 #include <boost/noncopyable.hpp>
 #include <boost/property_tree/ptree.hpp>
 
+#include <json_document.h>
 
 namespace osquery {
 
@@ -45,9 +46,33 @@ class Pack : private boost::noncopyable {
     initialize(name, source, tree);
   }
 
+  Pack(const std::string& name,
+       const std::string& source,
+       const JSONValue& pack) {
+    initialize(name, source, pack);
+  }
+
   void initialize(const std::string& name,
                   const std::string& source,
                   const boost::property_tree::ptree& tree);
+
+  /**
+   * @brief Initialize the pack from a parsed config document.
+   *
+   * The pack copies what it needs, the document may be released afterward.
+   */
+  void initialize(const std::string& name,
+                  const std::string& source,
+                  const JSONValue& pack);
+
+  /**
+   * @brief Add scheduled queries from a "queries" object.
+   *
+   * A config's top-level "schedule" has the same form, and becomes the
+   * queries of its source's "main" pack.
+   */
+  void addQueries(const JSONValue& queries);
+
   /**
    * @brief Getter for the pack's discovery query
    *
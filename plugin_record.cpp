@@ -0,0 +1,225 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+
+#include <core.h>
+#include <flat_index.h>
+#include <plugin_record.h>
+
+namespace osquery {
+
+constexpr size_t PluginArena::kBlockSize;
+
+/// Replaced value bytes a record keeps before it compacts its arena.
+const size_t kRecordCompactBytes = 256;
+
+/**
+ * @brief Process-wide key interning, keys are never released.
+ *
+ * Lookups probe the published table without a lock. Inserts are serialized
+ * by the mutex and fill a slot by publishing its hash last. A full table is
+ * copied into one twice its size; replaced tables are kept, as a reader may
+ * still probe them, and together are smaller than the published table.
+ */
+struct PluginKeyTable {
+  struct Table {
+    explicit Table(size_t size)
+        : capacity(size),
+          hashes(new std::atomic<uint64_t>[size]()),
+          keys(new PluginKey[size]()) {}
+
+    /// Always a power of two, so probing can mask.
+    size_t capacity;
+
+    /// Slot hashes, 0 is an empty slot.
+    std::unique_ptr<std::atomic<uint64_t>[]> hashes;
+
+    /// Slot keys, written before the slot's hash is published.
+    std::unique_ptr<PluginKey[]> keys;
+  };
+
+  PluginKeyTable() : table(new Table(kMinCapacity)) {
+    tables.emplace_back(table.load());
+  }
+
+  /// Find an interned key in a table, nullptr if it is not interned.
+  static PluginKey find(const Table& table,
+                        boost::string_ref key,
+                        uint64_t hash) {
+    auto mask = table.capacity - 1;
+    for (auto i = hash & mask;; i = (i + 1) & mask) {
+      auto slot_hash = table.hashes[i].load(std::memory_order_acquire);
+      if (slot_hash == 0) {
+        return nullptr;
+      }
+      if (slot_hash == hash && *table.keys[i] == key) {
+        return table.keys[i];
+      }
+    }
+  }
+
+  /// Place a key in the first empty slot of its probe sequence.
+  static void place(Table& table, PluginKey key, uint64_t hash) {
+    auto mask = table.capacity - 1;
+    auto i = hash & mask;
+    while (table.hashes[i].load(std::memory_order_relaxed) != 0) {
+      i = (i + 1) & mask;
+    }
+    table.keys[i] = key;
+    table.hashes[i].store(hash, std::memory_order_release);
+  }
+
+  static constexpr size_t kMinCapacity = 64;
+
+  std::atomic<Table*> table;
+
+  /// Every table published, only changed with the mutex held.
+  std::vector<std::unique_ptr<Table>> tables;
+
+  /// Interned keys, deque elements do not move.
+  std::deque<std::string> names;
+
+  Mutex mutex;
+};
+
+constexpr size_t PluginKeyTable::kMinCapacity;
+
+static PluginKeyTable& getKeyTable() {
+  static PluginKeyTable table;
+  return table;
+}
+
+PluginKey internPluginKey(boost::string_ref key) {
+  auto& keys = getKeyTable();
+  auto hash = hashName(key);
+  auto id = PluginKeyTable::find(
+      *keys.table.load(std::memory_order_acquire), key, hash);
+  if (id != nullptr) {
+    return id;
+  }
+
+  WriteLock lock(keys.mutex);
+  auto table = keys.table.load(std::memory_order_relaxed);
+  id = PluginKeyTable::find(*table, key, hash);
+  if (id != nullptr) {
+    return id;
+  }
+
+  if ((keys.names.size() + 1) * 2 > table->capacity) {
+    auto next = new PluginKeyTable::Table(table->capacity * 2);
+    for (const auto& name : keys.names) {
+      PluginKeyTable::place(*next, &name, hashName(name));
+    }
+    keys.tables.emplace_back(next);
+    keys.table.store(next, std::memory_order_release);
+    table = next;
+  }
+
+  keys.names.emplace_back(key.data(), key.size());
+  id = &keys.names.back();
+  PluginKeyTable::place(*table, id, hash);
+  return id;
+}
+
+void PluginArena::grow(size_t size) {
+  block_size_ = std::max(std::max(kBlockSize, block_size_ * 2), size);
+  blocks_.emplace_back(new char[block_size_]);
+  used_ = 0;
+}
+
+void PluginArena::reset() {
+  if (blocks_.size() > 1) {
+    // Keep the newest, and largest, block.
+    blocks_.front() = std::move(blocks_.back());
+    blocks_.resize(1);
+  }
+  used_ = 0;
+}
+
+PluginRecord& PluginRecord::operator=(const PluginRecord& other) {
+  if (this != &other) {
+    clear();
+    for (const auto& field : other.fields_) {
+      fields_.push_back({field.key, arena_.store(field.value)});
+    }
+  }
+  return *this;
+}
+
+PluginRecord::PluginRecord(const std::map<std::string, std::string>& request) {
+  // Map keys are unique, no field needs replacing.
+  fields_.reserve(request.size());
+  for (const auto& item : request) {
+    fields_.push_back({internPluginKey(item.first), arena_.store(item.second)});
+  }
+}
+
+std::map<std::string, std::string> PluginRecord::toMap() const {
+  std::map<std::string, std::string> request;
+  for (const auto& field : fields_) {
+    // A record adapted from a map keeps its order, so the hint is exact.
+    request.emplace_hint(request.end(), *field.key, field.value.to_string());
+  }
+  return request;
+}
+
+void PluginRecord::replace(Field& field, boost::string_ref value) {
+  if (value.size() <= field.value.size()) {
+    // Overwrite in place, the value may alias this record's arena.
+    replaced_ += field.value.size() - value.size();
+    if (value.empty()) {
+      field.value = boost::string_ref();
+    } else {
+      auto data = const_cast<char*>(field.value.data());
+      std::memmove(data, value.data(), value.size());
+      field.value = boost::string_ref(data, value.size());
+    }
+    return;
+  }
+
+  replaced_ += field.value.size();
+  field.value = arena_.store(value);
+  size_t live = 0;
+  for (const auto& other : fields_) {
+    live += other.value.size();
+  }
+  if (replaced_ > kRecordCompactBytes && replaced_ > live) {
+    compact();
+  }
+}
+
+void PluginRecord::compact() {
+  PluginArena arena;
+  for (auto& field : fields_) {
+    field.value = arena.store(field.value);
+  }
+  arena_ = std::move(arena);
+  replaced_ = 0;
+}
+
+const boost::string_ref* PluginRecord::find(boost::string_ref key) const {
+  for (const auto& field : fields_) {
+    if (*field.key == key) {
+      return &field.value;
+    }
+  }
+  return nullptr;
+}
+
+void PluginRecord::clear() {
+  fields_.clear();
+  arena_.reset();
+  replaced_ = 0;
+}
+}
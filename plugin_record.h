@@ -0,0 +1,193 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#pragma once
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/container/small_vector.hpp>
+#include <boost/utility/string_ref.hpp>
+
+namespace osquery {
+
+/// An interned request key, equal keys share one address.
+using PluginKey = const std::string*;
+
+/**
+ * @brief Intern a request key, returning a process-wide stable identifier.
+ *
+ * Requests reuse a handful of keys ("action", "name", ...) millions of times.
+ * Each key's characters are stored once for the life of the process. Lookups
+ * of an interned key take no lock, but hash and compare the key; hot callers
+ * should intern once and keep the identifier in a static.
+ */
+PluginKey internPluginKey(boost::string_ref key);
+
+/**
+ * @brief A bump allocator owning the value bytes of one PluginRecord.
+ *
+ * Blocks are heap allocated and never move, so references into the arena
+ * remain valid when the arena itself is moved.
+ */
+class PluginArena {
+ public:
+  PluginArena() = default;
+  PluginArena(PluginArena&&) = default;
+  PluginArena& operator=(PluginArena&&) = default;
+
+  /// Copy bytes into the arena and return the stored copy.
+  boost::string_ref store(boost::string_ref value) {
+    if (value.empty()) {
+      return boost::string_ref();
+    }
+    if (blocks_.empty() || block_size_ - used_ < value.size()) {
+      grow(value.size());
+    }
+
+    auto data = blocks_.back().get() + used_;
+    std::memcpy(data, value.data(), value.size());
+    used_ += value.size();
+    return boost::string_ref(data, value.size());
+  }
+
+  /// Release all but one block for reuse.
+  void reset();
+
+ private:
+  /// Start a new block with room for at least size bytes.
+  void grow(size_t size);
+
+ private:
+  /// The first block size, sized for a typical small request.
+  static constexpr size_t kBlockSize = 256;
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  size_t block_size_{0};
+  size_t used_{0};
+};
+
+/**
+ * @brief A flat, contiguous key/value record.
+ *
+ * A drop-in alternative to the std::map based PluginRequest: keys are
+ * interned, values live in a per-record PluginArena, and fields are kept in
+ * insertion order in a small inline vector. Building a record of a few
+ * fields costs one arena block instead of a tree node and two strings per
+ * field.
+ *
+ * Plugins may override Plugin::callRecord to consume records directly, the
+ * default implementation adapts to the PluginRequest map.
+ */
+class PluginRecord {
+ public:
+  struct Field {
+    PluginKey key;
+    boost::string_ref value;
+  };
+
+  using Fields = boost::container::small_vector<Field, 8>;
+
+ public:
+  PluginRecord() = default;
+  PluginRecord(PluginRecord&&) = default;
+  PluginRecord& operator=(PluginRecord&&) = default;
+
+  PluginRecord(const PluginRecord& other) {
+    *this = other;
+  }
+
+  PluginRecord& operator=(const PluginRecord& other);
+
+  /// Compatibility adapter from the map representation.
+  explicit PluginRecord(const std::map<std::string, std::string>& request);
+
+  /// Compatibility adapter to the map representation.
+  std::map<std::string, std::string> toMap() const;
+
+  /**
+   * @brief Set a field using an interned key, replacing any existing value.
+   *
+   * A replaced value is overwritten in place if the new value fits, a value
+   * previously returned for the key by find or get is invalidated.
+   */
+  void set(PluginKey key, boost::string_ref value) {
+    for (auto& field : fields_) {
+      if (field.key == key) {
+        replace(field, value);
+        return;
+      }
+    }
+    fields_.push_back({key, arena_.store(value)});
+  }
+
+  /// Set a field, interning the key.
+  void set(boost::string_ref key, boost::string_ref value) {
+    set(internPluginKey(key), value);
+  }
+
+  /// Find a field's value, nullptr if the record does not contain key.
+  const boost::string_ref* find(PluginKey key) const {
+    for (const auto& field : fields_) {
+      if (field.key == key) {
+        return &field.value;
+      }
+    }
+    return nullptr;
+  }
+  const boost::string_ref* find(boost::string_ref key) const;
+
+  /// Get a field's value, empty if the record does not contain key.
+  boost::string_ref get(boost::string_ref key) const {
+    auto value = find(key);
+    return (value == nullptr) ? boost::string_ref() : *value;
+  }
+
+  size_t count(boost::string_ref key) const {
+    return (find(key) == nullptr) ? 0 : 1;
+  }
+
+  size_t size() const {
+    return fields_.size();
+  }
+
+  bool empty() const {
+    return fields_.empty();
+  }
+
+  /// Drop every field, keeping one arena block for reuse.
+  void clear();
+
+  Fields::const_iterator begin() const {
+    return fields_.begin();
+  }
+
+  Fields::const_iterator end() const {
+    return fields_.end();
+  }
+
+ private:
+  /// Replace an existing field's value.
+  void replace(Field& field, boost::string_ref value);
+
+  /// Copy the live values into a new arena, dropping replaced values.
+  void compact();
+
+ private:
+  Fields fields_;
+  PluginArena arena_;
+
+  /// Arena bytes held by replaced values, reclaimed by compact.
+  size_t replaced_{0};
+};
+}
@@ -0,0 +1,255 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <algorithm>
+
+#include <plugin_stats.h>
+
+namespace osquery {
+
+/// Items per shard chunk, chunks are allocated when first recorded.
+const size_t kStatsChunkSize = 64;
+
+namespace {
+
+/// One item's counters, written only by the owning thread. Calls are
+/// counted apart, see PluginStatsCalls.
+struct ShardCounters {
+  std::atomic<uint64_t> errors{0};
+  std::atomic<uint64_t> sampled{0};
+  std::atomic<uint64_t> request_bytes{0};
+  std::atomic<uint64_t> response_bytes{0};
+  std::array<std::atomic<uint64_t>, kCallLatencyBuckets> latency{};
+};
+
+using ShardChunk = std::array<ShardCounters, kStatsChunkSize>;
+
+/// Single writer increment, readers tolerate a momentarily stale value.
+inline void bump(std::atomic<uint64_t>& counter, uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+inline void add(PluginCallStats& stats, const ShardCounters& counters) {
+  stats.errors += counters.errors.load(std::memory_order_relaxed);
+  stats.sampled += counters.sampled.load(std::memory_order_relaxed);
+  stats.request_bytes += counters.request_bytes.load(std::memory_order_relaxed);
+  stats.response_bytes +=
+      counters.response_bytes.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < kCallLatencyBuckets; i++) {
+    stats.latency[i] += counters.latency[i].load(std::memory_order_relaxed);
+  }
+}
+}
+
+/// A recording thread's counters, folded into the totals when it exits.
+struct PluginStatsShard {
+  PluginStatsShard() {
+    auto& stats = PluginStats::get();
+    WriteLock lock(stats.mutex_);
+    stats.shards_.insert(this);
+  }
+
+  ~PluginStatsShard() {
+    PluginStats::get().retire(*this);
+    PluginStats::thread_calls_ = PluginStatsCalls();
+  }
+
+  ShardCounters& counters(size_t id) {
+    auto chunk = id / kStatsChunkSize;
+    if (chunk >= chunks.size() || chunks[chunk] == nullptr) {
+      // Readers walk the chunk list, only growth needs the lock.
+      WriteLock lock(mutex);
+      if (chunk >= chunks.size()) {
+        chunks.resize(chunk + 1);
+      }
+      chunks[chunk].reset(new ShardChunk());
+    }
+    return (*chunks[chunk])[id % kStatsChunkSize];
+  }
+
+  /// Add this shard's call counts to totals indexed by id.
+  void addCalls(std::vector<PluginCallStats>& totals) const {
+    for (size_t id = 0; id < calls_size && id < totals.size(); id++) {
+      totals[id].calls += calls[id].load(std::memory_order_relaxed);
+    }
+  }
+
+  Mutex mutex;
+  std::vector<std::unique_ptr<ShardChunk>> chunks;
+
+  /// Call counts by id, the owning thread reaches them through
+  /// PluginStats::thread_calls_.
+  std::unique_ptr<std::atomic<uint64_t>[]> calls;
+  size_t calls_size{0};
+};
+
+thread_local PluginStatsCalls PluginStats::thread_calls_;
+
+static PluginStatsShard& getShard() {
+  static thread_local PluginStatsShard shard;
+  return shard;
+}
+
+uint64_t PluginCallStats::latencyPercentile(double percentile) const {
+  uint64_t total = 0;
+  for (auto count : latency) {
+    total += count;
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  auto target = static_cast<uint64_t>(percentile * total);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kCallLatencyBuckets; i++) {
+    seen += latency[i];
+    if (seen > target || seen == total) {
+      return (uint64_t{1} << (i + 1)) - 1;
+    }
+  }
+  return 0;
+}
+
+size_t PluginStats::id(const std::string& registry, const std::string& item) {
+  auto name = std::make_pair(registry, item);
+  {
+    ReadLock lock(mutex_);
+    auto it = ids_.find(name);
+    if (it != ids_.end()) {
+      return it->second;
+    }
+  }
+
+  WriteLock lock(mutex_);
+  auto& id = ids_[name];
+  if (id == 0) {
+    id = names_.size();
+    names_.push_back(std::move(name));
+  }
+  return id;
+}
+
+void PluginStats::record(size_t id,
+                         uint64_t nanoseconds,
+                         bool failed,
+                         size_t request_bytes,
+                         size_t response_bytes) {
+  if (id == 0) {
+    return;
+  }
+
+  auto& counters = getShard().counters(id);
+  if (failed) {
+    bump(counters.errors, 1);
+  }
+  bump(counters.sampled, 1);
+  bump(counters.request_bytes, request_bytes);
+  bump(counters.response_bytes, response_bytes);
+
+  // The bucket is floor(log2(nanoseconds)), 0 and 1 share the first.
+  size_t bucket = (nanoseconds <= 1) ? 0 : 63 - __builtin_clzll(nanoseconds);
+  bump(counters.latency[std::min(bucket, kCallLatencyBuckets - 1)], 1);
+}
+
+bool PluginStats::countSlow(size_t id) {
+  auto& shard = getShard();
+  auto size = std::max(shard.calls_size, kStatsChunkSize);
+  while (size <= id) {
+    size *= 2;
+  }
+
+  std::unique_ptr<std::atomic<uint64_t>[]> calls(
+      new std::atomic<uint64_t>[size]());
+  {
+    // Readers sum the counts with the shard's lock held.
+    WriteLock lock(shard.mutex);
+    for (size_t i = 0; i < shard.calls_size; i++) {
+      calls[i].store(shard.calls[i].load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+    }
+    shard.calls.swap(calls);
+    shard.calls_size = size;
+  }
+  thread_calls_.counts = shard.calls.get();
+  thread_calls_.size = size;
+  return count(id);
+}
+
+void PluginStats::error(size_t id) {
+  if (id == 0) {
+    return;
+  }
+
+  auto& counters = getShard().counters(id);
+  bump(counters.errors, 1);
+}
+
+std::vector<PluginCallStats> PluginStats::snapshot() const {
+  ReadLock lock(mutex_);
+  std::vector<PluginCallStats> totals(names_.size());
+  for (size_t id = 0; id < retired_.size(); id++) {
+    totals[id] = retired_[id];
+  }
+
+  for (auto shard : shards_) {
+    ReadLock shard_lock(shard->mutex);
+    shard->addCalls(totals);
+    for (size_t chunk = 0; chunk < shard->chunks.size(); chunk++) {
+      if (shard->chunks[chunk] == nullptr) {
+        continue;
+      }
+      for (size_t i = 0; i < kStatsChunkSize; i++) {
+        auto id = chunk * kStatsChunkSize + i;
+        if (id < totals.size()) {
+          add(totals[id], (*shard->chunks[chunk])[i]);
+        }
+      }
+    }
+  }
+
+  std::vector<PluginCallStats> stats;
+  for (size_t id = 1; id < totals.size(); id++) {
+    if (totals[id].calls == 0) {
+      continue;
+    }
+    totals[id].registry = names_[id].first;
+    totals[id].item = names_[id].second;
+    if (totals[id].sampled > 0 && totals[id].sampled < totals[id].calls) {
+      // Estimate the bytes of the calls that were not sized.
+      auto scale = static_cast<double>(totals[id].calls) / totals[id].sampled;
+      totals[id].request_bytes =
+          static_cast<uint64_t>(totals[id].request_bytes * scale);
+      totals[id].response_bytes =
+          static_cast<uint64_t>(totals[id].response_bytes * scale);
+    }
+    stats.push_back(std::move(totals[id]));
+  }
+  return stats;
+}
+
+void PluginStats::retire(PluginStatsShard& shard) {
+  WriteLock lock(mutex_);
+  shards_.erase(&shard);
+  retired_.resize(std::max(retired_.size(), names_.size()));
+  shard.addCalls(retired_);
+  for (size_t chunk = 0; chunk < shard.chunks.size(); chunk++) {
+    if (shard.chunks[chunk] == nullptr) {
+      continue;
+    }
+    for (size_t i = 0; i < kStatsChunkSize; i++) {
+      auto id = chunk * kStatsChunkSize + i;
+      if (id < retired_.size()) {
+        add(retired_[id], (*shard.chunks[chunk])[i]);
+      }
+    }
+  }
+}
+}
@@ -0,0 +1,298 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <core.h>
+#include <plugin_record.h>
+
+namespace osquery {
+
+/// Bucket i counts calls that took [2^i, 2^(i+1)) nanoseconds.
+const size_t kCallLatencyBuckets = 40;
+
+/// Each thread times and sizes one call to each item in this many, the rest
+/// are counted.
+const uint32_t kCallSampleRate = 16;
+
+/// A snapshot of one registry item's call counters.
+struct PluginCallStats {
+  std::string registry;
+  std::string item;
+
+  uint64_t calls{0};
+  uint64_t errors{0};
+
+  /// The calls that were timed and sized, see kCallSampleRate.
+  uint64_t sampled{0};
+
+  /// Key and value bytes of the requests and responses.
+  ///
+  /// Only sampled calls are sized, a snapshot scales their bytes by
+  /// calls / sampled.
+  uint64_t request_bytes{0};
+  uint64_t response_bytes{0};
+
+  /// A log2 histogram of the sampled calls' latency in nanoseconds.
+  std::array<uint64_t, kCallLatencyBuckets> latency{};
+
+  /// The upper bound of the bucket holding a latency percentile, in [0, 1].
+  uint64_t latencyPercentile(double percentile) const;
+};
+
+struct PluginStatsShard;
+
+/**
+ * @brief The calling thread's call counts, indexed by PluginStats id.
+ *
+ * The counts belong to the thread's shard. This view is trivially
+ * constructible, so counting a call needs no thread_local initialization.
+ */
+struct PluginStatsCalls {
+  std::atomic<uint64_t>* counts{nullptr};
+  size_t size{0};
+};
+
+/**
+ * @brief Per registry item call counters.
+ *
+ * Each recording thread owns a shard of counters, so recording is a few
+ * uncontended relaxed stores with no locks or shared cache lines. Readers
+ * sum every live shard plus the totals of threads that have exited.
+ *
+ * Counting a call is one increment of a thread-local count. Only sampled
+ * calls and failures look up the item's other counters in the shard.
+ *
+ * Items are identified by a small integer, assigned once per (registry,
+ * item) name pair by RegistryInterface when the item is added.
+ */
+class PluginStats : private boost::noncopyable {
+ public:
+  static PluginStats& get() {
+    // Never destroyed, shards of exiting threads fold into the totals.
+    static auto stats = new PluginStats();
+    return *stats;
+  }
+
+  /// The identifier for a (registry, item) pair, stable across re-adds.
+  size_t id(const std::string& registry, const std::string& item);
+
+  /**
+   * @brief Count a call, and check if it should be timed and sized.
+   *
+   * Items are sampled independently, one call in kCallSampleRate to each
+   * item per thread, starting with the first. id must not be 0.
+   */
+  static bool count(size_t id) {
+    auto& calls = thread_calls_;
+    if (id >= calls.size) {
+      return countSlow(id);
+    }
+    auto& count = calls.counts[id];
+    auto previous = count.load(std::memory_order_relaxed);
+    count.store(previous + 1, std::memory_order_relaxed);
+    return (previous % kCallSampleRate) == 0;
+  }
+
+  /// Record a counted call that was timed and sized, id 0 is ignored.
+  void record(size_t id,
+              uint64_t nanoseconds,
+              bool failed,
+              size_t request_bytes,
+              size_t response_bytes);
+
+  /// Record that a counted call, which was not sampled, failed.
+  void error(size_t id);
+
+  /// A snapshot of every item that has been called.
+  std::vector<PluginCallStats> snapshot() const;
+
+  /// Recording may be disabled, callers then skip timing entirely.
+  bool enabled() const {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  void enabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+  }
+
+ private:
+  PluginStats() = default;
+
+  /// Fold an exiting thread's counters into retired_.
+  void retire(PluginStatsShard& shard);
+
+  /// Grow the calling thread's counts to include id, then count.
+  static bool countSlow(size_t id);
+
+  /// The calling thread's view of its shard's call counts.
+  static thread_local PluginStatsCalls thread_calls_;
+
+ private:
+  mutable Mutex mutex_;
+
+  /// Registry and item names, indexed by id.
+  std::vector<std::pair<std::string, std::string>> names_{{"", ""}};
+  std::map<std::pair<std::string, std::string>, size_t> ids_;
+
+  /// Live shards, one per recording thread.
+  std::set<PluginStatsShard*> shards_;
+
+  /// Counters from threads that have exited, indexed by id.
+  std::vector<PluginCallStats> retired_;
+
+  std::atomic<bool> enabled_{true};
+
+ private:
+  friend struct PluginStatsShard;
+};
+
+/**
+ * @brief A PluginStats identifier assigned on first use.
+ *
+ * Registries hold one per item and route, most are never called, so the
+ * (registry, item) name pair is only interned when a call needs the id.
+ */
+class PluginStatsId {
+ public:
+  PluginStatsId() = default;
+
+  PluginStatsId(const PluginStatsId& other)
+      : id_(other.id_.load(std::memory_order_relaxed)) {}
+
+  PluginStatsId& operator=(const PluginStatsId& other) {
+    id_.store(other.id_.load(std::memory_order_relaxed),
+              std::memory_order_relaxed);
+    return *this;
+  }
+
+  /// The identifier, racing first calls assign the same one.
+  size_t get(const std::string& registry, const std::string& item) const {
+    auto id = id_.load(std::memory_order_relaxed);
+    if (id == 0) {
+      id = PluginStats::get().id(registry, item);
+      id_.store(id, std::memory_order_relaxed);
+    }
+    return id;
+  }
+
+ private:
+  mutable std::atomic<size_t> id_{0};
+};
+
+/// Key and value bytes of a request map.
+inline size_t pluginRequestBytes(const std::map<std::string, std::string>& r) {
+  size_t bytes = 0;
+  for (const auto& field : r) {
+    bytes += field.first.size() + field.second.size();
+  }
+  return bytes;
+}
+
+inline size_t pluginRequestBytes(const PluginRecord& record) {
+  size_t bytes = 0;
+  for (const auto& field : record) {
+    bytes += field.key->size() + field.value.size();
+  }
+  return bytes;
+}
+
+/**
+ * @brief Time one registry item call and record it in PluginStats.
+ *
+ * Construct before the call and finish after it. A call that throws is
+ * recorded as an error when the timer is destroyed without finishing.
+ *
+ * Every call is counted, but reading the clock and summing request and
+ * response sizes cost more than a typical local call. Only one call in
+ * kCallSampleRate to each item per thread is timed and sized.
+ */
+class PluginCallTimer : private boost::noncopyable {
+ public:
+  explicit PluginCallTimer(size_t id)
+      : id_(PluginStats::get().enabled() ? id : 0),
+        sampled_(id_ != 0 && PluginStats::count(id_)) {
+    if (sampled_) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~PluginCallTimer() {
+    finish(false, 0, 0);
+  }
+
+  /**
+   * @brief Record the completed call.
+   *
+   * @param offset The response size before the call, only rows the call
+   * appended are counted.
+   */
+  template <class Request, class Response>
+  void finish(bool ok,
+              const Request& request,
+              const Response& response,
+              size_t offset) {
+    if (!sampled_) {
+      finish(ok, 0, 0);
+      return;
+    }
+
+    size_t response_bytes = 0;
+    for (size_t i = offset; i < response.size(); i++) {
+      response_bytes += pluginRequestBytes(response[i]);
+    }
+    finish(ok, pluginRequestBytes(request), response_bytes);
+  }
+
+  /// Record the completed call with sizes counted by the caller.
+  void finish(bool ok, size_t request_bytes, size_t response_bytes) {
+    if (id_ == 0) {
+      return;
+    }
+    if (sampled_) {
+      PluginStats::get().record(
+          id_, elapsed(), !ok, request_bytes, response_bytes);
+    } else if (!ok) {
+      PluginStats::get().error(id_);
+    }
+    id_ = 0;
+  }
+
+  /// The call is being sized, callers may skip counting bytes if not.
+  bool recording() const {
+    return id_ != 0 && sampled_;
+  }
+
+ private:
+  uint64_t elapsed() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start_)
+        .count();
+  }
+
+ private:
+  size_t id_;
+  bool sampled_;
+  std::chrono::steady_clock::time_point start_;
+};
+}
@@ -0,0 +1,195 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include <epoch.h>
+#include <flat_index.h>
+
+namespace osquery {
+
+/**
+ * @brief A string-keyed index changed in place while readers probe it.
+ *
+ * A FlatIndex published copy-on-write costs a full copy per change. This
+ * index is changed by a single writer, serialized by its owner, while
+ * readers call find within an EpochDomain::ReadSection without a lock.
+ *
+ * Values are immutable once set. Setting a key publishes the new value and
+ * retires the one it replaces, so a value found by a reader stays valid
+ * until its read section ends. A key's slot never moves while its table is
+ * published: an erased key keeps its slot, and the table is rebuilt without
+ * erased keys once half of the slots are used. A change is amortized O(1).
+ */
+template <typename Value>
+class PublishedIndex : private boost::noncopyable {
+ public:
+  PublishedIndex() : table_(new Table(kMinCapacity)) {}
+
+  ~PublishedIndex() {
+    auto table = table_.load();
+    for (size_t i = 0; i < table->capacity; i++) {
+      delete table->entries[i].value.load();
+    }
+    delete table;
+  }
+
+  /// Find the value for a key, nullptr if there is none.
+  const Value* find(boost::string_ref key) const {
+    const auto* table = table_.load(std::memory_order_acquire);
+    auto hash = hashName(key);
+    auto mask = table->capacity - 1;
+    for (auto i = hash & mask;; i = (i + 1) & mask) {
+      auto slot_hash = table->hashes[i].load(std::memory_order_acquire);
+      if (slot_hash == 0) {
+        return nullptr;
+      }
+      const auto& entry = table->entries[i];
+      if (slot_hash == hash && key == entry.key) {
+        return entry.value.load(std::memory_order_acquire);
+      }
+    }
+  }
+
+  /**
+   * @brief Publish a key's value, nullptr erases the key.
+   *
+   * The index takes ownership of value. Only one thread may change the
+   * index at a time.
+   */
+  void set(boost::string_ref key, const Value* value) {
+    auto table = table_.load(std::memory_order_relaxed);
+    auto hash = hashName(key);
+    auto i = probe(*table, key, hash);
+    if (table->hashes[i].load(std::memory_order_relaxed) == 0) {
+      if (value == nullptr) {
+        return;
+      }
+      if ((table->used + 1) * 2 > table->capacity) {
+        table = rebuild(*table);
+        i = probe(*table, key, hash);
+      }
+
+      // Readers only compare the key once the hash is published.
+      auto& entry = table->entries[i];
+      entry.key.assign(key.data(), key.size());
+      entry.value.store(value, std::memory_order_relaxed);
+      table->hashes[i].store(hash, std::memory_order_release);
+      table->used++;
+      size_++;
+      return;
+    }
+
+    auto previous =
+        table->entries[i].value.exchange(value, std::memory_order_acq_rel);
+    if (previous != nullptr) {
+      size_ -= (value == nullptr) ? 1 : 0;
+      EpochDomain::get().retire(previous);
+    } else {
+      size_ += (value != nullptr) ? 1 : 0;
+    }
+  }
+
+  /// Number of keys with a value.
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  struct Entry {
+    std::string key;
+
+    /// nullptr once the key is erased.
+    std::atomic<const Value*> value{nullptr};
+  };
+
+  /// Values are shared with the next table, a table does not own them.
+  struct Table {
+    explicit Table(size_t size)
+        : capacity(size),
+          hashes(new std::atomic<uint64_t>[size]()),
+          entries(new Entry[size]) {}
+
+    /// Always a power of two, so probing can mask.
+    size_t capacity;
+
+    /// Slots with a key, including erased keys.
+    size_t used{0};
+
+    /// Slot hashes, 0 is an empty slot. Kept apart from keys for dense
+    /// probing.
+    std::unique_ptr<std::atomic<uint64_t>[]> hashes;
+
+    /// Slot keys and values, parallel to hashes.
+    std::unique_ptr<Entry[]> entries;
+  };
+
+  /// Return the slot holding key, or the empty slot where it would be placed.
+  static size_t probe(const Table& table,
+                      boost::string_ref key,
+                      uint64_t hash) {
+    auto mask = table.capacity - 1;
+    for (auto i = hash & mask;; i = (i + 1) & mask) {
+      auto slot_hash = table.hashes[i].load(std::memory_order_relaxed);
+      if (slot_hash == 0 ||
+          (slot_hash == hash && key == table.entries[i].key)) {
+        return i;
+      }
+    }
+  }
+
+  /// Publish a copy of the keys with values, sized for as many inserts.
+  Table* rebuild(const Table& table) {
+    auto capacity = kMinCapacity;
+    while (capacity < (size_ + 1) * 4) {
+      capacity *= 2;
+    }
+
+    auto next = new Table(capacity);
+    for (size_t i = 0; i < table.capacity; i++) {
+      const auto& entry = table.entries[i];
+      auto value = entry.value.load(std::memory_order_relaxed);
+      if (value == nullptr) {
+        continue;
+      }
+
+      auto hash = table.hashes[i].load(std::memory_order_relaxed);
+      auto j = probe(*next, entry.key, hash);
+      next->entries[j].key = entry.key;
+      next->entries[j].value.store(value, std::memory_order_relaxed);
+      next->hashes[j].store(hash, std::memory_order_relaxed);
+      next->used++;
+    }
+
+    table_.store(next, std::memory_order_release);
+    EpochDomain::get().retire(&table);
+    return next;
+  }
+
+ private:
+  static constexpr size_t kMinCapacity = 16;
+
+  std::atomic<Table*> table_;
+
+  /// Number of keys with a value, only read and written by the writer.
+  size_t size_{0};
+};
+
+template <typename Value>
+constexpr size_t PublishedIndex<Value>::kMinCapacity;
+}
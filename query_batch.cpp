@@ -0,0 +1,156 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <algorithm>
+#include <set>
+
+#include <query_batch.h>
+
+namespace osquery {
+
+constexpr size_t RowBatch::kMaxColumnBytes;
+
+static ColumnDictionaryRef makeDictionary(const ColumnNames& columns) {
+  auto dictionary = std::make_shared<ColumnDictionary>();
+  for (const auto& column : columns) {
+    if (dictionary->index.find(column) == nullptr) {
+      dictionary->index[column] = dictionary->names.size();
+      dictionary->names.push_back(column);
+    }
+  }
+  return dictionary;
+}
+
+RowBatch::RowBatch() : RowBatch(ColumnNames()) {}
+
+RowBatch::RowBatch(const ColumnNames& columns)
+    : RowBatch(makeDictionary(columns)) {}
+
+RowBatch::RowBatch(ColumnDictionaryRef dictionary)
+    : dictionary_(std::move(dictionary)),
+      columns_(dictionary_->names.size()) {}
+
+Status RowBatch::fromQueryData(const QueryData& rows, RowBatch& batch) {
+  std::set<std::string> names;
+  for (const auto& row : rows) {
+    for (const auto& column : row) {
+      names.insert(column.first);
+    }
+  }
+
+  batch = RowBatch(ColumnNames(names.begin(), names.end()));
+  size_t bytes = 0;
+  for (const auto& row : rows) {
+    for (const auto& column : row) {
+      bytes += column.second.size();
+    }
+  }
+
+  // Reserve using the average column width to avoid regrowth.
+  for (auto& column : batch.columns_) {
+    column.offsets.reserve(rows.size() + 1);
+    column.present.reserve(rows.size());
+    if (!names.empty()) {
+      column.values.reserve(std::min(bytes / names.size(), kMaxColumnBytes));
+    }
+  }
+
+  for (const auto& row : rows) {
+    auto status = batch.addRow(row);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return Status(0, "OK");
+}
+
+QueryData RowBatch::toQueryData() const {
+  QueryData rows;
+  rows.reserve(rows_);
+  for (size_t i = 0; i < rows_; i++) {
+    rows.push_back(getRow(i));
+  }
+  return rows;
+}
+
+Row RowBatch::getRow(size_t row) const {
+  Row result;
+  for (size_t i = 0; i < columns_.size(); i++) {
+    if (hasValue(row, i)) {
+      result.emplace(dictionary_->names[i], value(row, i).to_string());
+    }
+  }
+  return result;
+}
+
+size_t RowBatch::columnIndex(boost::string_ref column) const {
+  auto index = dictionary_->index.find(column);
+  return (index == nullptr) ? columns_.size() : *index;
+}
+
+size_t RowBatch::addColumn(const std::string& column) {
+  // Copy-on-write, other batches may share the dictionary.
+  auto dictionary = std::make_shared<ColumnDictionary>(*dictionary_);
+  auto index = dictionary->names.size();
+  dictionary->index[column] = index;
+  dictionary->names.push_back(column);
+  dictionary_ = dictionary;
+
+  Column data;
+  data.offsets.assign(rows_ + 1, 0);
+  data.present.assign(rows_, 0);
+  columns_.push_back(std::move(data));
+  return index;
+}
+
+Status RowBatch::addRow(const Row& row) {
+  // Check every value first, a rejected row must not be partially added.
+  for (const auto& item : row) {
+    auto index = columnIndex(item.first);
+    auto used = (index == columns_.size()) ? 0 : columns_[index].values.size();
+    if (item.second.size() > kMaxColumnBytes - used) {
+      return Status(
+          1, STATUS_LITERAL("Row batch column is full: "), item.first);
+    }
+  }
+
+  for (const auto& item : row) {
+    auto index = columnIndex(item.first);
+    if (index == columns_.size()) {
+      index = addColumn(item.first);
+    }
+
+    auto& column = columns_[index];
+    column.values.append(item.second);
+    column.offsets.push_back(static_cast<uint32_t>(column.values.size()));
+    column.present.push_back(1);
+  }
+
+  rows_++;
+  for (auto& column : columns_) {
+    if (column.present.size() < rows_) {
+      // The row did not include this column.
+      column.offsets.push_back(column.offsets.back());
+      column.present.push_back(0);
+    }
+  }
+  return Status(0, "OK");
+}
+
+size_t RowBatch::bytes() const {
+  size_t bytes = columns_.capacity() * sizeof(Column);
+  for (const auto& column : columns_) {
+    bytes += column.values.capacity();
+    bytes += column.offsets.capacity() * sizeof(uint32_t);
+    bytes += column.present.capacity();
+  }
+  return bytes;
+}
+}
@@ -0,0 +1,140 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/utility/string_ref.hpp>
+
+#include <core.h>
+#include <flat_index.h>
+
+namespace osquery {
+
+/// A set of column names and their positions, shared between batches.
+struct ColumnDictionary {
+  ColumnNames names;
+  FlatIndex<size_t> index;
+};
+
+using ColumnDictionaryRef = std::shared_ptr<const ColumnDictionary>;
+
+/**
+ * @brief A columnar representation of QueryData.
+ *
+ * Each Row in QueryData repeats every column name in its own std::map. A
+ * RowBatch stores the column names once, in a ColumnDictionary that batches
+ * from the same query share, and each column's values back-to-back in one
+ * buffer with an offset per row.
+ *
+ * QueryData rows may omit columns, a batch tracks which values are present
+ * so the conversion back to QueryData is exact.
+ *
+ * Convert at API boundaries using RowBatch::fromQueryData and
+ * RowBatch::toQueryData. RegistryFactory::callTable can stream a table as
+ * RowBatches sharing one dictionary.
+ */
+class RowBatch {
+ public:
+  RowBatch();
+
+  /// Start an empty batch with a known set of columns.
+  explicit RowBatch(const ColumnNames& columns);
+
+  /// Start an empty batch sharing another batch's columns.
+  explicit RowBatch(ColumnDictionaryRef dictionary);
+
+  /**
+   * @brief Build a batch from rows, the columns are the union of all row keys.
+   *
+   * Fails, leaving batch with the rows before the failure, if a column
+   * would exceed kMaxColumnBytes.
+   */
+  static Status fromQueryData(const QueryData& rows, RowBatch& batch);
+
+  /// Expand the batch back into rows.
+  QueryData toQueryData() const;
+
+  /**
+   * @brief Append a row, unknown columns are added to the batch.
+   *
+   * A row that would grow a column past kMaxColumnBytes is rejected and the
+   * batch is unchanged.
+   */
+  Status addRow(const Row& row);
+
+  /// Expand a single row.
+  Row getRow(size_t row) const;
+
+  /// Position of a column, or columnCount() if the column is unknown.
+  size_t columnIndex(boost::string_ref column) const;
+
+  /// Check if a row has a value for a column.
+  bool hasValue(size_t row, size_t column) const {
+    return columns_[column].present[row] != 0;
+  }
+
+  /// A value, empty if the row did not include the column.
+  boost::string_ref value(size_t row, size_t column) const {
+    const auto& data = columns_[column];
+    return boost::string_ref(data.values.data() + data.offsets[row],
+                             data.offsets[row + 1] - data.offsets[row]);
+  }
+
+  const ColumnNames& columns() const {
+    return dictionary_->names;
+  }
+
+  const ColumnDictionaryRef& dictionary() const {
+    return dictionary_;
+  }
+
+  size_t columnCount() const {
+    return columns_.size();
+  }
+
+  size_t rowCount() const {
+    return rows_;
+  }
+
+  /// Approximate heap bytes owned by this batch, excluding the dictionary.
+  size_t bytes() const;
+
+  /// A column's values are addressed by 32-bit offsets.
+  static constexpr size_t kMaxColumnBytes =
+      std::numeric_limits<uint32_t>::max();
+
+ private:
+  /// Add a column not yet in the dictionary, filling prior rows as absent.
+  size_t addColumn(const std::string& column);
+
+ private:
+  struct Column {
+    /// Every value of this column, back-to-back.
+    std::string values;
+
+    /// Row i's value is values[offsets[i], offsets[i + 1]), a batch column
+    /// is limited to kMaxColumnBytes of values.
+    std::vector<uint32_t> offsets{0};
+
+    /// Row i included this column.
+    std::vector<uint8_t> present;
+  };
+
+  ColumnDictionaryRef dictionary_;
+  std::vector<Column> columns_;
+  size_t rows_{0};
+};
+}
@@ -8,248 +8,815 @@
  *
  */
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
+#include <limits>
 #include <sstream>
+#include <tuple>
 #include <iostream>
 
+#include <broadcast.h>
+#include <executor.h>
+#include <query_batch.h>
 #include <registry.h>
+#include <tables.h>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 
 namespace pt = boost::property_tree;
 
+#ifndef WIN32
+#include <dirent.h>
+#include <dlfcn.h>
+#endif
+
 namespace osquery {
 
-void registryAndPluginInit() {
+std::atomic<size_t> RegistryFactory::broadcast_generation_{0};
+
+struct ModuleStage {
+  RouteUUID uuid{0};
+
+  /// The path, then the module's declaration.
+  ModuleInfo info;
+
+  /// Accepted by declareModule, a module that never declares is rejected.
+  Status declaration{1, "Module did not declare itself"};
+
+  /// Registrations are being committed, not staged.
+  bool committing{false};
+
+  std::vector<RegistryRegistration> registries;
+  std::vector<PluginRegistration> plugins;
+  AutoRegisterSet dynamic_registries;
+  AutoRegisterSet dynamic_plugins;
+};
+
+namespace {
+
+/// The module being opened, declared, or committed on this thread.
+thread_local ModuleStage* current_module{nullptr};
+
+/// Make a module current on this thread for a scope.
+class ModuleScope : private boost::noncopyable {
+ public:
+  explicit ModuleScope(ModuleStage& stage) : previous_(current_module) {
+    current_module = &stage;
+  }
+
+  ~ModuleScope() {
+    current_module = previous_;
+  }
+
+ private:
+  ModuleStage* previous_;
+};
+
+/// The module staging registrations on this thread, or nullptr.
+ModuleStage* stagingModule() {
+  auto module = current_module;
+  return (module == nullptr || module->committing) ? nullptr : module;
+}
+
+/// Compare the numeric components of two SDK versions, ignoring a suffix.
+bool sdkVersionAtLeast(const std::string& version, const std::string& minimum) {
+  const char* v = version.c_str();
+  const char* m = minimum.c_str();
+  while (*v != '\0' || *m != '\0') {
+    char* v_end = nullptr;
+    char* m_end = nullptr;
+    auto v_part = std::strtoul(v, &v_end, 10);
+    auto m_part = std::strtoul(m, &m_end, 10);
+    if (v_part != m_part) {
+      return v_part > m_part;
+    }
+    v = (*v_end == '.') ? v_end + 1 : "";
+    m = (*m_end == '.') ? m_end + 1 : "";
+  }
+  return true;
+}
+}
+
+void AutoRegisterInterface::autoloadRegistry(
+    std::unique_ptr<AutoRegisterInterface> ar_) {
+  auto module = stagingModule();
+  if (module != nullptr) {
+    module->dynamic_registries.push_back(std::move(ar_));
+  } else {
+    registries().push_back(std::move(ar_));
+  }
+}
+
+void AutoRegisterInterface::autoloadPlugin(
+    std::unique_ptr<AutoRegisterInterface> ar_) {
+  auto module = stagingModule();
+  if (module != nullptr) {
+    module->dynamic_plugins.push_back(std::move(ar_));
+  } else {
+    plugins().push_back(std::move(ar_));
+  }
+}
+
+void registerRegistries(const RegistryRegistration* begin,
+                        const RegistryRegistration* end) {
+  auto module = stagingModule();
+  if (module != nullptr) {
+    module->registries.insert(module->registries.end(), begin, end);
+    return;
+  }
+
+  auto& factory = RegistryFactory::get();
+  for (auto it = begin; it != end; ++it) {
+    factory.add(it->type, it->create(it->name, it->optional));
+  }
+}
+
+Status registerPlugins(const PluginRegistration* begin,
+                       const PluginRegistration* end) {
+  auto module = stagingModule();
+  if (module != nullptr) {
+    module->plugins.insert(module->plugins.end(), begin, end);
+    return Status(0, "OK");
+  }
+
+  auto& factory = RegistryFactory::get();
+  Status status(0, "OK");
+
+  // A registry's records are usually adjacent, each run is added in a batch.
+  std::unique_ptr<RegistryInterface::Batch> batch;
+  RegistryInterface* batched = nullptr;
+  for (auto it = begin; it != end; ++it) {
+    auto registry = factory.tryRegistry(it->type);
+    if (!registry) {
+      status = status.ok() ? registry.getStatus() : status;
+      continue;
+    }
+    if (*registry != batched) {
+      batch.reset();
+      batch.reset(new RegistryInterface::Batch(**registry));
+      batched = *registry;
+    }
+    auto added = (*registry)->addFactory(it->name, it->create, it->internal);
+    status = status.ok() ? added : status;
+  }
+  return status;
+}
+
+Status registryAndPluginInit() {
+  Status status(0, "OK");
+  auto record = [&status](Status added) {
+    if (!added.ok() && status.ok()) {
+      status = std::move(added);
+    }
+  };
+
+#ifdef OSQUERY_STATIC_REGISTRATION
+  registerRegistries(__start_osquery_registries, __stop_osquery_registries);
+  record(registerPlugins(__start_osquery_plugins, __stop_osquery_plugins));
+#endif
+
   for (const auto& it : AutoRegisterInterface::registries()) {
-    it->run();
+    record(it->run());
   }
 
   for (const auto& it : AutoRegisterInterface::plugins()) {
-    it->run();
+    record(it->run());
   }
 
   AutoRegisterSet().swap(AutoRegisterInterface::registries());
   AutoRegisterSet().swap(AutoRegisterInterface::plugins());
+  return status;
 }
 
+RegistryInterface::Batch::Batch(RegistryInterface& registry)
+    : registry_(registry), lock_(registry.mutex_) {
+  registry_.batch_depth_++;
+}
 
-void RegistryInterface::remove(const std::string& item_name) {
-  if (items_.count(item_name) > 0) {
-    items_[item_name]->tearDown();
-    items_.erase(item_name);
+RegistryInterface::Batch::~Batch() {
+  if (--registry_.batch_depth_ > 0) {
+    return;
   }
 
-  // Populate list of aliases to remove (those that mask item_name).
-  std::vector<std::string> removed_aliases;
-  for (const auto& alias : aliases_) {
-    if (alias.second == item_name) {
-      removed_aliases.push_back(alias.first);
+  // Only now can no handle resolve a removed item, see resolve.
+  if (registry_.stale_) {
+    registry_.stale_ = false;
+    registry_.invalidate();
+  }
+}
+
+RegistryInterface::ItemEntry* RegistryInterface::findItem(
+    const std::string& item_name) const {
+  auto slot = index_.find(item_name);
+  return (slot == nullptr) ? nullptr : slot->item.get();
+}
+
+void RegistryInterface::remove(const std::string& item_name) {
+  remove(item_name, true);
+}
+
+void RegistryInterface::remove(const std::string& item_name, bool tear_down) {
+  PluginRef plugin;
+  {
+    Batch batch(*this);
+    auto item = items_.find(item_name);
+    if (item != items_.end()) {
+      if (tear_down && constructed(*item->second)) {
+        plugin = item->second->plugin;
+      }
+      setSlot(item_name, [](ItemSlot& slot) { slot.item = nullptr; });
+      items_.erase(item);
+      stale_ = true;
+      routeChanged(item_name);
+    }
+
+    // Remove the aliases that mask item_name.
+    auto removed_aliases = item_aliases_.equal_range(item_name);
+    for (auto it = removed_aliases.first; it != removed_aliases.second; ++it) {
+      const auto& alias = it->second;
+      setSlot(alias, [](ItemSlot& slot) { slot.alias.clear(); });
+      aliases_.erase(alias);
+      routeChanged(alias);
     }
+    item_aliases_.erase(removed_aliases.first, removed_aliases.second);
   }
 
-  for (const auto& alias : removed_aliases) {
-    aliases_.erase(alias);
+  // The item is no longer published, a tearDown cannot race a new call.
+  if (plugin != nullptr) {
+    plugin->tearDown();
   }
 }
 
-bool RegistryInterface::isInternal(const std::string& item_name) const {
-  if (std::find(internal_.begin(), internal_.end(), item_name) ==
-      internal_.end()) {
-    return false;
+void RegistryInterface::routeChanged(const std::string& name) {
+  invalidateRoutes();
+  auto generation = RegistryFactory::broadcast_generation_.fetch_add(
+                        1, std::memory_order_acq_rel) +
+                    1;
+  auto previous = route_generations_.find(name);
+  if (previous != route_generations_.end()) {
+    route_log_.erase(previous->second);
+    previous->second = generation;
+  } else {
+    route_generations_[name] = generation;
   }
-  return true;
+  route_log_[generation] = name;
+}
+
+bool RegistryInterface::isInternal(const std::string& item_name) const {
+  EpochDomain::ReadSection section;
+  auto item = findItem(item_name);
+  return item != nullptr && item->internal;
 }
 
 Status RegistryInterface::setActive(const std::string& item_name) {
   // Default support multiple active plugins.
 
+  // An active plugin will be called, construct it now.
+  EpochDomain::ReadSection section;
+  auto item = findItem(item_name);
+  if (item != nullptr) {
+    try {
+      instance(*item);
+    } catch (const std::exception& e) {
+      return Status(1, e.what());
+    }
+  }
+
   Status status(0, "OK");
   return status;
 }
 
-RegistryRoutes RegistryInterface::getRoutes() const {
-  RegistryRoutes route_table;
-  for (const auto& item : items_) {
-    if (isInternal(item.first)) {
-      // This is an internal plugin, do not include the route.
-      continue;
+std::map<std::string, PluginRef> RegistryInterface::plugins() {
+  std::map<std::string, ItemEntryRef> items;
+  {
+    std::lock_guard<RecursiveMutex> lock(mutex_);
+    items = items_;
+  }
+
+  // Construct outside of the lock, a factory may use the registry.
+  std::map<std::string, PluginRef> plugins;
+  for (const auto& item : items) {
+    try {
+      plugins.emplace_hint(plugins.end(), item.first, instance(*item.second));
+    } catch (const std::exception& /* e */) {
+      // The item failed to construct and has been removed.
+    }
+  }
+  return plugins;
+}
+
+void RegistryInterface::construct(ItemEntry& item) const {
+  bool constructing = false;
+  std::call_once(item.once, [this, &item, &constructing]() {
+    constructing = true;
+    auto plugin = item.create();
+    if (plugin == nullptr || !accepts(*plugin)) {
+      item.failure = Status(
+          1, STATUS_LITERAL("Cannot add foreign plugin type: "), item.name);
+      return;
     }
 
-    bool has_alias = false;
-    for (const auto& alias : aliases_) {
-      if (alias.second == item.first) {
-        // If the item name is masked by at least one alias, it will not
-        // broadcast under the internal item name.
-        route_table[alias.first] = item.second->routeInfo();
-        has_alias = true;
+    plugin->setName(item.name);
+    if (auto_setup_ && set_up_.load(std::memory_order_acquire)) {
+      // The registry setUp has passed, this item missed it.
+      auto status = plugin->setUp();
+      if (!status.ok()) {
+        item.failure = Status(
+            1, "Plugin setUp failed: " + item.name + ": " + status.what());
+        return;
       }
     }
 
-    if (!has_alias) {
-      route_table[item.first] = item.second->routeInfo();
+    item.plugin = std::move(plugin);
+    item.ready.store(true, std::memory_order_release);
+  });
+
+  auto ready = item.ready.load(std::memory_order_acquire);
+  if (constructing) {
+    // Construction is part of a lookup, the registry itself is not const.
+    const_cast<RegistryInterface*>(this)->finishConstruct(item, !ready);
+  }
+
+  // The once flag is set even if construction failed, report the failure.
+  if (!ready) {
+    throw std::runtime_error(item.failure.getMessage());
+  }
+}
+
+void RegistryInterface::finishConstruct(const ItemEntry& item, bool failed) {
+  Batch batch(*this);
+  auto current = items_.find(item.name);
+  if (current == items_.end() || current->second.get() != &item) {
+    // The item was removed or replaced while it was constructed.
+    return;
+  }
+
+  if (failed) {
+    // Like a failed setUp, exists, names, and routes drop the item.
+    remove(item.name, false);
+  } else if (!item.internal) {
+    routeChanged(item.name);
+    auto aliases = item_aliases_.equal_range(item.name);
+    for (auto alias = aliases.first; alias != aliases.second; ++alias) {
+      routeChanged(alias->second);
+    }
+  }
+}
+
+RegistryRoutes RegistryInterface::getRoutes() const {
+  return getRoutesCache()->routes;
+}
+
+std::shared_ptr<const RegistryInterface::RoutesCache>
+RegistryInterface::getRoutesCache() const {
+  // Read the version first, a change while computing fails the next check.
+  auto version = routes_version_.load(std::memory_order_acquire);
+  auto cache = std::atomic_load(&routes_cache_);
+  if (cache != nullptr && cache->version == version) {
+    return cache;
+  }
+
+  auto next = std::make_shared<RoutesCache>();
+  next->version = version;
+  next->routes = computeRoutes();
+  encodeRoutes(next->routes, next->encoded);
+  cache = std::move(next);
+  std::atomic_store(&routes_cache_, cache);
+  return cache;
+}
+
+RegistryRoutes RegistryInterface::computeRoutes() const {
+  // Each broadcast plugin with the names it is broadcast under.
+  std::vector<std::pair<PluginRef, std::vector<std::string>>> broadcast;
+  {
+    std::lock_guard<RecursiveMutex> lock(mutex_);
+    for (const auto& item : items_) {
+      if (item.second->internal) {
+        // This is an internal plugin, do not include the route.
+        continue;
+      }
+
+      if (!constructed(*item.second)) {
+        // Not used yet, it is broadcast once constructed.
+        continue;
+      }
+
+      // If the item name is masked by at least one alias, it will not
+      // broadcast under the internal item name.
+      std::vector<std::string> names;
+      auto aliases = item_aliases_.equal_range(item.first);
+      for (auto alias = aliases.first; alias != aliases.second; ++alias) {
+        names.push_back(alias->second);
+      }
+      if (names.empty()) {
+        names.push_back(item.first);
+      }
+      broadcast.emplace_back(item.second->plugin, std::move(names));
+    }
+  }
+
+  // Route info is published by the plugin, called outside of the lock.
+  RegistryRoutes route_table;
+  for (const auto& item : broadcast) {
+    for (const auto& name : item.second) {
+      route_table[name] = item.first->routeInfo();
     }
   }
   return route_table;
 }
 
+bool RegistryInterface::getRoute(const std::string& name,
+                                 PluginResponse& route) const {
+  PluginRef plugin;
+  {
+    std::lock_guard<RecursiveMutex> lock(mutex_);
+    // An alias broadcasts its item's route.
+    auto alias = aliases_.find(name);
+    const auto& item_name = (alias != aliases_.end()) ? alias->second : name;
+    auto it = items_.find(item_name);
+    if (it == items_.end() || it->second->internal ||
+        !constructed(*it->second)) {
+      return false;
+    }
+
+    if (alias == aliases_.end() && item_aliases_.count(name) > 0) {
+      // An item masked by an alias is only broadcast under the alias.
+      return false;
+    }
+    plugin = it->second->plugin;
+  }
+
+  route = plugin->routeInfo();
+  return true;
+}
+
+RegistryRoutesDelta RegistryInterface::getRoutesDelta(size_t since) const {
+  RegistryRoutesDelta delta;
+  if (broadcast_added_ > since) {
+    // The receiver has never seen this registry.
+    delta.added = getRoutes();
+    return delta;
+  }
+
+  std::vector<std::string> changed;
+  {
+    std::lock_guard<RecursiveMutex> lock(mutex_);
+    for (auto it = route_log_.upper_bound(since); it != route_log_.end();
+         ++it) {
+      changed.push_back(it->second);
+    }
+  }
+
+  for (const auto& name : changed) {
+    PluginResponse route;
+    if (getRoute(name, route)) {
+      delta.added[name] = std::move(route);
+    } else {
+      delta.removed.push_back(name);
+    }
+  }
+  return delta;
+}
+
 Status RegistryInterface::call(const std::string& item_name,
                                const PluginRequest& request,
                                PluginResponse& response) {
-  // Search local plugins (items) for the plugin.
-  if (items_.count(item_name) > 0) {
-    return items_.at(item_name)->call(request, response);
+  // Search local plugins (items) for the plugin, the section keeps the item
+  // alive during the call.
+  EpochDomain::ReadSection section;
+  auto item = findItem(item_name);
+  if (item != nullptr) {
+    const auto& plugin = instance(*item);
+    PluginCallTimer timer(statsId(*item));
+    auto offset = response.size();
+    auto status = plugin->call(request, response);
+    timer.finish(status.ok(), request, response, offset);
+    return status;
+  }
+
+  RouteUUID uuid;
+  size_t stats;
+  if (findExternal(item_name, uuid, stats)) {
+    PluginCallTimer timer(stats);
+    auto offset = response.size();
+    auto status = RegistryFactory::get().callExternal(
+        uuid, name_, item_name, request, response);
+    timer.finish(status.ok(), request, response, offset);
+    return status;
   }
 
-  return Status(1, "Cannot call registry item: " + item_name);
+  return Status(1, STATUS_LITERAL("Cannot call registry item: "), item_name);
 }
 
 Status RegistryInterface::addAlias(const std::string& item_name,
                                    const std::string& alias) {
+  Batch batch(*this);
   if (aliases_.count(alias) > 0) {
-    return Status(1, "Duplicate alias: " + alias);
+    return Status(1, STATUS_LITERAL("Duplicate alias: "), alias);
   }
   aliases_[alias] = item_name;
+  setSlot(alias, [&item_name](ItemSlot& slot) { slot.alias = item_name; });
+  item_aliases_.emplace(item_name, alias);
+
+  // The alias is broadcast and now masks the item name.
+  routeChanged(alias);
+  routeChanged(item_name);
   return Status(0, "OK");
 }
 
 std::string RegistryInterface::getAlias(const std::string& alias) const {
-  if (aliases_.count(alias) == 0) {
+  EpochDomain::ReadSection section;
+  auto slot = index_.find(alias);
+  if (slot == nullptr || slot->alias.empty()) {
     return alias;
   }
-  return aliases_.at(alias);
+  return slot->alias;
 }
 
 Status RegistryInterface::addPlugin(const std::string& plugin_name,
                                     const PluginRef& plugin_item,
                                     bool internal) {
+  return addItem(plugin_name, plugin_item, nullptr, internal);
+}
+
+Status RegistryInterface::addItem(const std::string& plugin_name,
+                                  const PluginRef& plugin_item,
+                                  PluginFactory factory,
+                                  bool internal) {
+  Batch batch(*this);
   if (items_.count(plugin_name) > 0) {
-    return Status(1, "Duplicate registry item exists: " + plugin_name);
+    return Status(
+        1, STATUS_LITERAL("Duplicate registry item exists: "), plugin_name);
   }
 
-  plugin_item->setName(plugin_name);
-  items_.emplace(std::make_pair(plugin_name, plugin_item));
+  auto item = std::make_shared<ItemEntry>();
+  item->name = plugin_name;
+  item->create = factory;
 
   // The item can be listed as internal, meaning it does not broadcast.
-  if (internal) {
-    internal_.push_back(plugin_name);
+  item->internal = internal;
+  if (factory == nullptr) {
+    if (plugin_item != nullptr) {
+      plugin_item->setName(plugin_name);
+    }
+    item->plugin = plugin_item;
+    item->ready.store(true, std::memory_order_release);
   }
+  items_[plugin_name] = item;
+  setSlot(plugin_name, [&item](ItemSlot& slot) { slot.item = item; });
 
   // The item may belong to a module.
   if (RegistryFactory::get().usingModule()) {
     modules_[plugin_name] = RegistryFactory::get().getModule();
   }
 
+  // An item added by factory is broadcast once constructed.
+  if (!internal && factory == nullptr) {
+    routeChanged(plugin_name);
+
+    // Aliases added before the item are broadcast from now on.
+    auto aliases = item_aliases_.equal_range(plugin_name);
+    for (auto alias = aliases.first; alias != aliases.second; ++alias) {
+      routeChanged(alias->second);
+    }
+  }
   return Status(0, "OK");
 }
 
+Status RegistryInterface::addFactory(const std::string& plugin_name,
+                                     PluginFactory factory,
+                                     bool internal) {
+  // Index an unconstructed item, exists and names do not construct it.
+  return addItem(plugin_name, nullptr, factory, internal);
+}
+
 void RegistryInterface::setUp() {
-  // If this registry does not auto-setup do NOT setup the registry items.
-  if (!auto_setup_) {
-    return;
-  }
+  RegistryFactory::setUpRegistries({this});
+}
 
-  // If the registry is using a single 'active' plugin, setUp that plugin.
-  // For config and logger, only setUp the selected plugin.
-  if (active_.size() != 0 && exists(active_, true)) {
-    items_.at(active_)->setUp();
-    return;
-  }
+std::map<std::string, std::chrono::microseconds>
+RegistryInterface::getSetUpDurations() const {
+  std::lock_guard<RecursiveMutex> lock(mutex_);
+  return setup_durations_;
+}
 
-  // Try to set up each of the registry items.
-  // If they fail, remove them from the registry.
-  std::vector<std::string> failed;
-  for (auto& item : items_) {
-    if (!item.second->setUp().ok()) {
-      failed.push_back(item.first);
+void RegistryInterface::configure() {
+  PluginRef active;
+  {
+    EpochDomain::ReadSection section;
+    auto item = (active_.empty()) ? nullptr : findItem(active_);
+    if (item != nullptr) {
+      active = instance(*item);
     }
   }
-
-  for (const auto& failed_item : failed) {
-    remove(failed_item);
+  if (active != nullptr) {
+    active->configure();
+    return;
   }
-}
 
-void RegistryInterface::configure() {
-  if (!active_.empty() && exists(active_, true)) {
-    items_.at(active_)->configure();
-  } else {
-    for (auto& item : items_) {
-      item.second->configure();
+  // Items constructed later read the configuration in setUp.
+  std::vector<PluginRef> plugins;
+  {
+    std::lock_guard<RecursiveMutex> lock(mutex_);
+    for (const auto& item : items_) {
+      if (constructed(*item.second)) {
+        plugins.push_back(item.second->plugin);
+      }
     }
   }
+  for (const auto& plugin : plugins) {
+    plugin->configure();
+  }
 }
 
 Status RegistryInterface::addExternal(const RouteUUID& uuid,
                                       const RegistryRoutes& routes) {
+  std::lock_guard<RecursiveMutex> lock(mutex_);
+  displaced_.clear();
+  if (routes.empty()) {
+    return Status(0, "OK");
+  }
+
+  auto& items = external_items_[uuid];
+  items.reserve(items.size() + routes.size());
+
   // Add each route name (item name) to the tracking.
+  Status status(0, "OK");
   for (const auto& route : routes) {
     // Keep the routes info assigned to the registry.
-    routes_[route.first] = route.second;
-    auto status = addExternalPlugin(route.first, route.second);
-    external_[route.first] = uuid;
+    status = addExternalPlugin(route.first, route.second);
+    auto owner = externals_.find(route.first);
+    if (owner != nullptr) {
+      // Another extension owned the name, keep its route for a rollback.
+      displaced_.emplace(route.first, *owner);
+    }
+
+    auto external = new ExternalRoute();
+    external->uuid = uuid;
+    external->info = route.second;
+    externals_.set(route.first, external);
+    items.push_back(route.first);
     if (!status.ok()) {
-      return status;
+      break;
     }
   }
-  return Status(0, "OK");
+
+  invalidate();
+  invalidateRoutes();
+  return status;
+}
+
+bool RegistryInterface::findExternal(const std::string& item_name,
+                                     RouteUUID& uuid,
+                                     size_t& stats) const {
+  EpochDomain::ReadSection section;
+  auto route = externals_.find(item_name);
+  if (route == nullptr) {
+    return false;
+  }
+  uuid = route->uuid;
+  stats = route->stats.get(name_, item_name);
+  return true;
+}
+
+std::map<std::string, RouteUUID> RegistryInterface::getExternal() const {
+  std::map<std::string, RouteUUID> external;
+  std::lock_guard<RecursiveMutex> lock(mutex_);
+  for (const auto& items : external_items_) {
+    for (const auto& item : items.second) {
+      auto owner = externals_.find(item);
+      if (owner != nullptr && owner->uuid == items.first) {
+        external[item] = items.first;
+      }
+    }
+  }
+  return external;
 }
 
 /// Remove all the routes for a given uuid.
 void RegistryInterface::removeExternal(const RouteUUID& uuid) {
-  std::vector<std::string> removed_items;
-  for (const auto& item : external_) {
-    if (item.second == uuid) {
-      removeExternalPlugin(item.first);
-      removed_items.push_back(item.first);
-    }
+  removeExternal(uuid, false);
+}
+
+void RegistryInterface::rollbackExternal(const RouteUUID& uuid) {
+  removeExternal(uuid, true);
+  displaced_.clear();
+}
+
+void RegistryInterface::removeExternal(const RouteUUID& uuid, bool rollback) {
+  std::lock_guard<RecursiveMutex> lock(mutex_);
+  auto items = external_items_.find(uuid);
+  if (items == external_items_.end()) {
+    return;
   }
 
-  // Remove items belonging to the external uuid.
-  for (const auto& item : removed_items) {
-    external_.erase(item);
-    routes_.erase(item);
+  // Only the routes this uuid added are visited.
+  for (const auto& item : items->second) {
+    auto owner = externals_.find(item);
+    if (owner == nullptr || owner->uuid != uuid) {
+      // A later broadcast took over the name.
+      continue;
+    }
+
+    removeExternalPlugin(item);
+    auto previous = rollback ? displaced_.find(item) : displaced_.end();
+    if (previous == displaced_.end()) {
+      externals_.set(item, nullptr);
+      continue;
+    }
+
+    // The previous owner still lists the name in external_items_.
+    externals_.set(item, new ExternalRoute(previous->second));
+    addExternalPlugin(item, previous->second.info);
   }
+
+  external_items_.erase(items);
+  invalidate();
+  invalidateRoutes();
 }
 
 /// Facility method to check if a registry item exists.
 bool RegistryInterface::exists(const std::string& item_name, bool local) const {
-  bool has_local = (items_.count(item_name) > 0);
-  bool has_external = (external_.count(item_name) > 0);
-  bool has_route = (routes_.count(item_name) > 0);
-  return (local) ? has_local : has_local || has_external || has_route;
+  EpochDomain::ReadSection section;
+  if (findItem(item_name) != nullptr) {
+    return true;
+  }
+
+  return !local && externals_.find(item_name) != nullptr;
 }
 
 /// Facility method to list the registry item identifiers.
 std::vector<std::string> RegistryInterface::names() const {
   std::vector<std::string> names;
-  for (const auto& item : items_) {
-    names.push_back(item.first);
+  {
+    std::lock_guard<RecursiveMutex> lock(mutex_);
+    for (const auto& item : items_) {
+      names.push_back(item.first);
+    }
   }
 
   // Also add names of external plugins.
-  for (const auto& item : external_) {
-    names.push_back(item.first);
+  for (const auto& route : getExternal()) {
+    names.push_back(route.first);
   }
   return names;
 }
 
 void RegistryFactory::add(const std::string& name, RegistryInterfaceRef reg) {
-  if (exists(name)) {
+  WriteLock lock(mutex_);
+  auto current = registries_.load(std::memory_order_acquire);
+  if (current->index.find(name) != nullptr) {
     throw std::runtime_error("Cannot add duplicate registry: " + name);
   }
-  registries_[name] = std::move(reg);
+
+  reg->broadcast_added_ =
+      broadcast_generation_.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+  // Copy-on-write, readers of the current snapshot are undisturbed.
+  auto next = new RegistrySnapshot(*current);
+  next->index[name] = reg.get();
+  next->registries[name] = std::move(reg);
+  registries_.store(next, std::memory_order_release);
+  EpochDomain::get().retire(current);
+}
+
+RegistryInterface* RegistryFactory::find(
+    const std::string& registry_name) const {
+  EpochDomain::ReadSection section;
+  auto registry = registries_.load(std::memory_order_acquire)
+                      ->index.find(registry_name);
+  return (registry == nullptr) ? nullptr : *registry;
 }
 
 RegistryInterfaceRef RegistryFactory::registry(const std::string& t) const {
-  if (!exists(t)) {
+  EpochDomain::ReadSection section;
+  const auto& registries =
+      registries_.load(std::memory_order_acquire)->registries;
+  auto it = registries.find(t);
+  if (it == registries.end()) {
     throw std::runtime_error("Unknown registry requested: " + t);
   }
-  return registries_.at(t);
+  return it->second;
+}
+
+Expected<RegistryInterface*> RegistryFactory::tryRegistry(
+    const std::string& registry_name) const {
+  auto registry = find(registry_name);
+  if (registry == nullptr) {
+    return Status(
+        1, STATUS_LITERAL("Unknown registry requested: "), registry_name);
+  }
+  return registry;
 }
 
 std::map<std::string, RegistryInterfaceRef> RegistryFactory::all() const {
-  return registries_;
+  EpochDomain::ReadSection section;
+  return registries_.load(std::memory_order_acquire)->registries;
 }
 
 std::map<std::string, PluginRef> RegistryFactory::plugins(
@@ -262,50 +829,170 @@ PluginRef RegistryFactory::plugin(const std::string& registry_name,
   return registry(registry_name)->plugin(item_name);
 }
 
+Expected<PluginRef> RegistryFactory::tryPlugin(
+    const std::string& registry_name, const std::string& item_name) const {
+  auto registry = tryRegistry(registry_name);
+  if (!registry) {
+    return registry.getStatus();
+  }
+  auto plugin = (*registry)->plugin(item_name);
+  if (plugin == nullptr) {
+    return Status(1, STATUS_LITERAL("Unknown registry item: "), item_name);
+  }
+  return plugin;
+}
+
 RegistryBroadcast RegistryFactory::getBroadcast() {
   RegistryBroadcast broadcast;
-  for (const auto& registry : registries_) {
+  EpochDomain::ReadSection section;
+  for (const auto& registry :
+       registries_.load(std::memory_order_acquire)->registries) {
     broadcast[registry.first] = registry.second->getRoutes();
   }
   return broadcast;
 }
 
+RegistryBroadcastDelta RegistryFactory::getBroadcastDelta(size_t since,
+                                                         size_t& generation) {
+  // Changes racing with the delta are resent with the next one.
+  generation = broadcastGeneration();
+
+  RegistryBroadcastDelta broadcast;
+  EpochDomain::ReadSection section;
+  for (const auto& registry :
+       registries_.load(std::memory_order_acquire)->registries) {
+    auto delta = registry.second->getRoutesDelta(since);
+    if (!delta.added.empty() || !delta.removed.empty()) {
+      broadcast[registry.first] = std::move(delta);
+    }
+  }
+  return broadcast;
+}
+
 Status RegistryFactory::addBroadcast(const RouteUUID& uuid,
                                      const RegistryBroadcast& broadcast) {
-  return Status(1, "Duplicate extension UUID:");
+  WriteLock lock(mutex_);
+  if (extensions_.count(uuid) > 0) {
+    return Status(
+        1, STATUS_LITERAL("Duplicate extension UUID: "), std::to_string(uuid));
+  }
+
+  EpochDomain::ReadSection section;
+  const auto& index = registries_.load(std::memory_order_acquire)->index;
+
+  // Validate everything before changing any registry.
+  std::vector<std::pair<RegistryInterface*, const RegistryRoutes*>> targets;
+  targets.reserve(broadcast.size());
+  for (const auto& routes : broadcast) {
+    auto registry = index.find(routes.first);
+    if (registry == nullptr) {
+      // The extension may use registries this process does not have.
+      continue;
+    }
+
+    if (!allow_duplicates_) {
+      for (const auto& route : routes.second) {
+        if ((*registry)->exists(route.first)) {
+          return Status(
+              1, STATUS_LITERAL("Duplicate registry item: "), route.first);
+        }
+      }
+    }
+    targets.emplace_back(*registry, &routes.second);
+  }
+
+  Status status(0, "OK");
+  size_t applied = 0;
+  while (applied < targets.size()) {
+    // A failing registry may have added some of its routes.
+    const auto& target = targets[applied++];
+    status = target.first->addExternal(uuid, *target.second);
+    if (!status.ok()) {
+      break;
+    }
+  }
+
+  if (!status.ok()) {
+    // A broadcast is atomic, undo the registries already applied.
+    for (size_t i = 0; i < applied; i++) {
+      targets[i].first->rollbackExternal(uuid);
+    }
+    return status;
+  }
+
+  extensions_.insert(uuid);
+  return Status(0, "OK");
 }
 
 Status RegistryFactory::removeBroadcast(const RouteUUID& uuid) {
   WriteLock lock(mutex_);
   if (extensions_.count(uuid) == 0) {
-    return Status(1, "Unknown extension UUID: " + std::to_string(uuid));
+    return Status(
+        1, STATUS_LITERAL("Unknown extension UUID: "), std::to_string(uuid));
   }
 
-  for (const auto& registry : registries_) {
+  EpochDomain::ReadSection section;
+  for (const auto& registry :
+       registries_.load(std::memory_order_acquire)->registries) {
     registry.second->removeExternal(uuid);
   }
   extensions_.erase(uuid);
+  transports_.erase(uuid);
+  return Status(0, "OK");
+}
+
+Status RegistryFactory::setTransport(const RouteUUID& uuid,
+                                     ExtensionTransportRef transport) {
+  WriteLock lock(mutex_);
+  if (extensions_.count(uuid) == 0) {
+    return Status(
+        1, STATUS_LITERAL("Unknown extension UUID: "), std::to_string(uuid));
+  }
+  transports_[uuid] = std::move(transport);
   return Status(0, "OK");
 }
 
+ExtensionTransportRef RegistryFactory::getTransport(
+    const RouteUUID& uuid) const {
+  ReadLock lock(mutex_);
+  auto it = transports_.find(uuid);
+  return (it == transports_.end()) ? nullptr : it->second;
+}
+
+Status RegistryFactory::callExternal(const RouteUUID& uuid,
+                                     const std::string& registry_name,
+                                     const std::string& item_name,
+                                     const PluginRequest& request,
+                                     PluginResponse& response) const {
+  auto transport = getTransport(uuid);
+  if (transport == nullptr) {
+    return Status(
+        1, STATUS_LITERAL("No transport to extension: "), std::to_string(uuid));
+  }
+  // The transport is held, a concurrent removeBroadcast does not close it.
+  return transport->call(registry_name, item_name, request, response);
+}
+
 /// Adds an alias for an internal registry item. This registry will only
 /// broadcast the alias name.
 Status RegistryFactory::addAlias(const std::string& registry_name,
                                  const std::string& item_name,
                                  const std::string& alias) {
-  if (!exists(registry_name)) {
-    return Status(1, "Unknown registry: " + registry_name);
+  auto registry = tryRegistry(registry_name);
+  if (!registry) {
+    return registry.getStatus();
   }
-  return registries_.at(registry_name)->addAlias(item_name, alias);
+  return (*registry)->addAlias(item_name, alias);
 }
 
 /// Returns the item_name or the item alias if an alias exists.
 std::string RegistryFactory::getAlias(const std::string& registry_name,
                                       const std::string& alias) const {
-  if (!exists(registry_name)) {
+  auto registry = tryRegistry(registry_name);
+  if (!registry) {
     return alias;
   }
-  return registries_.at(registry_name)->getAlias(alias);
+  return (*registry)->getAlias(alias);
 }
 
 Status RegistryFactory::call(const std::string& registry_name,
@@ -317,16 +1004,70 @@ Status RegistryFactory::call(const std::string& registry_name,
     if (item_name.find(",") != std::string::npos) {
       // Call is multiplexing plugins (usually for multiple loggers).
       // All multiplexed items are called without regard for statuses.
-      return Status(0);
+      std::vector<std::string> item_names;
+      boost::split(item_names, item_name, boost::is_any_of(","));
+      item_names.erase(
+          std::remove(item_names.begin(), item_names.end(), ""),
+          item_names.end());
+
+      std::vector<Status> statuses;
+      return callMultiplexed(
+          registry_name, item_names, request, response, statuses);
+    }
+    auto registry = get().tryRegistry(registry_name);
+    if (!registry) {
+      return registry.getStatus();
     }
-    return get().registry(registry_name)->call(item_name, request, response);
+    return (*registry)->call(item_name, request, response);
   } catch (const std::exception& e) {
     return Status(1, e.what());
   } catch (...) {
-    return Status(2, "Unknown exception");
+    return Status(2, STATUS_LITERAL("Unknown exception"));
   }
 }
 
+Status RegistryFactory::callMultiplexed(
+    const std::string& registry_name,
+    const std::vector<std::string>& item_names,
+    const PluginRequest& request,
+    PluginResponse& response,
+    std::vector<Status>& statuses) {
+  statuses.assign(item_names.size(), Status(0, "OK"));
+  std::vector<PluginResponse> responses(item_names.size());
+  {
+    TaskGroup group;
+    for (size_t i = 1; i < item_names.size(); i++) {
+      group.run([&, i]() {
+        statuses[i] =
+            call(registry_name, item_names[i], request, responses[i]);
+      });
+    }
+
+    // The calling thread handles the first item, then helps or waits.
+    if (!item_names.empty()) {
+      statuses[0] = call(registry_name, item_names[0], request, responses[0]);
+    }
+    group.wait();
+  }
+
+  std::string failed;
+  for (size_t i = 0; i < item_names.size(); i++) {
+    response.insert(response.end(),
+                    std::make_move_iterator(responses[i].begin()),
+                    std::make_move_iterator(responses[i].end()));
+    if (!statuses[i].ok()) {
+      failed += (failed.empty()) ? "" : ", ";
+      failed += item_names[i] + ": ";
+      statuses[i].appendMessage(failed);
+    }
+  }
+
+  if (!failed.empty()) {
+    return Status(1, STATUS_LITERAL("Multiplexed call failed: "), failed);
+  }
+  return Status(0, "OK");
+}
+
 Status RegistryFactory::call(const std::string& registry_name,
                              const std::string& item_name,
                              const PluginRequest& request) {
@@ -338,8 +1079,11 @@ Status RegistryFactory::call(const std::string& registry_name,
 Status RegistryFactory::call(const std::string& registry_name,
                              const PluginRequest& request,
                              PluginResponse& response) {
-  auto& plugin = get().registry(registry_name)->getActive();
-  return call(registry_name, plugin, request, response);
+  auto registry = get().tryRegistry(registry_name);
+  if (!registry) {
+    return registry.getStatus();
+  }
+  return call(registry_name, (*registry)->getActive(), request, response);
 }
 
 Status RegistryFactory::call(const std::string& registry_name,
@@ -348,42 +1092,738 @@ Status RegistryFactory::call(const std::string& registry_name,
   return call(registry_name, request, response);
 }
 
+Status RegistryFactory::callRecord(const std::string& registry_name,
+                                   const std::string& item_name,
+                                   const PluginRecord& request,
+                                   PluginResponse& response) {
+  auto registry = get().find(registry_name);
+  EpochDomain::ReadSection section;
+  auto item = (registry == nullptr) ? nullptr : registry->findItem(item_name);
+  if (item == nullptr) {
+    return call(registry_name, item_name, request.toMap(), response);
+  }
+
+  try {
+    const auto& plugin = registry->instance(*item);
+    PluginCallTimer timer(registry->statsId(*item));
+    auto offset = response.size();
+    auto status = plugin->callRecord(request, response);
+    timer.finish(status.ok(), request, response, offset);
+    return status;
+  } catch (const std::exception& e) {
+    return Status(1, e.what());
+  } catch (...) {
+    return Status(2, STATUS_LITERAL("Unknown exception"));
+  }
+}
+
+PluginCallHandle RegistryFactory::resolve(const std::string& registry_name,
+                                          const std::string& item_name) {
+  PluginCallHandle handle;
+  handle.registry_name_ = registry_name;
+  handle.item_name_ = item_name;
+
+  auto registry = get().find(registry_name);
+  if (registry == nullptr) {
+    return handle;
+  }
+
+  handle.registry_ = registry;
+  // Read the generation first, a racing removal will fail the next check.
+  handle.generation_ = registry->generation();
+  EpochDomain::ReadSection section;
+  auto item = registry->findItem(item_name);
+  if (item != nullptr) {
+    try {
+      handle.plugin_ = registry->instance(*item);
+      handle.stats_ = registry->statsId(*item);
+    } catch (const std::exception& /* e */) {
+      // Leave the handle unresolved, calls will report the failure.
+    }
+  }
+  return handle;
+}
+
+Status RegistryFactory::call(PluginCallHandle& handle,
+                             const PluginRequest& request,
+                             PluginResponse& response) {
+  if (!handle.valid()) {
+    handle = resolve(handle.registry_name_, handle.item_name_);
+    if (handle.plugin_ == nullptr) {
+      // Not a local plugin, use the named call for routing and errors.
+      return call(handle.registry_name_, handle.item_name_, request, response);
+    }
+  }
+
+  try {
+    PluginCallTimer timer(handle.stats_);
+    auto offset = response.size();
+    auto status = handle.plugin_->call(request, response);
+    timer.finish(status.ok(), request, response, offset);
+    return status;
+  } catch (const std::exception& e) {
+    return Status(1, e.what());
+  } catch (...) {
+    return Status(2, STATUS_LITERAL("Unknown exception"));
+  }
+}
+
+struct PluginCallFuture::State {
+  std::string registry_name;
+  std::string item_name;
+  PluginRequest request;
+
+  /// If set the result is handed to done rather than kept for get.
+  PluginCompletion done;
+
+  /// Claimed by the first of the queued task and a waiter.
+  std::atomic<bool> started{false};
+
+  /// Keeps a concurrently removed plugin alive until the call completes.
+  PluginRef plugin;
+  std::unique_ptr<PluginCallTimer> timer;
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool complete{false};
+  PluginCallResult result;
+
+  /// Complete the call, later completions are ignored.
+  void finish(Status status, PluginResponse response) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (complete) {
+      return;
+    }
+    complete = true;
+    if (timer != nullptr) {
+      timer->finish(status.ok(), request, response, 0);
+    }
+
+    if (done) {
+      auto callback = std::move(done);
+      lock.unlock();
+      callback(std::move(status), std::move(response));
+      return;
+    }
+    result.status = std::move(status);
+    result.response = std::move(response);
+    condition.notify_all();
+  }
+};
+
+bool PluginCallFuture::ready() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->complete;
+}
+
+void PluginCallFuture::wait() {
+  RegistryFactory::startAsync(state_);
+
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  state_->condition.wait(lock, [this]() { return state_->complete; });
+}
+
+PluginCallResult PluginCallFuture::get() {
+  wait();
+  auto state = std::move(state_);
+  std::lock_guard<std::mutex> lock(state->mutex);
+  return std::move(state->result);
+}
+
+void RegistryFactory::startAsync(
+    const std::shared_ptr<PluginCallFuture::State>& call) {
+  bool expected = false;
+  if (!call->started.compare_exchange_strong(expected, true)) {
+    return;
+  }
+
+  auto handle = resolve(call->registry_name, call->item_name);
+  if (handle.plugin_ == nullptr) {
+    // Not a local plugin, use the named call for routing and errors.
+    PluginResponse response;
+    auto status =
+        RegistryFactory::call(call->registry_name, call->item_name,
+                              call->request, response);
+    call->finish(std::move(status), std::move(response));
+    return;
+  }
+
+  call->plugin = handle.plugin_;
+  call->timer.reset(new PluginCallTimer(handle.stats_));
+  try {
+    call->plugin->callAsync(call->request,
+                            [call](Status status, PluginResponse response) {
+                              call->finish(std::move(status),
+                                           std::move(response));
+                            });
+  } catch (const std::exception& e) {
+    call->finish(Status(1, e.what()), PluginResponse());
+  } catch (...) {
+    call->finish(Status(
+        2, STATUS_LITERAL("Unknown exception")), PluginResponse());
+  }
+}
+
+PluginCallFuture RegistryFactory::callAsync(const std::string& registry_name,
+                                            const std::string& item_name,
+                                            const PluginRequest& request) {
+  auto call = std::make_shared<PluginCallFuture::State>();
+  call->registry_name = registry_name;
+  call->item_name = item_name;
+  call->request = request;
+  Executor::get().submit([call]() { startAsync(call); });
+
+  PluginCallFuture future;
+  future.state_ = std::move(call);
+  return future;
+}
+
+void RegistryFactory::callAsync(const std::string& registry_name,
+                                const std::string& item_name,
+                                const PluginRequest& request,
+                                PluginCompletion done) {
+  auto call = std::make_shared<PluginCallFuture::State>();
+  call->registry_name = registry_name;
+  call->item_name = item_name;
+  call->request = request;
+  call->done = std::move(done);
+  Executor::get().submit([call]() { startAsync(call); });
+}
+
+std::vector<PluginCallResult> RegistryFactory::callBatch(
+    const std::string& registry_name,
+    const std::string& item_name,
+    const std::vector<PluginRequest>& requests) {
+  std::vector<PluginCallResult> results;
+  results.reserve(requests.size());
+
+  auto registry = get().find(registry_name);
+  RouteUUID uuid;
+  size_t stats = 0;
+  auto transport =
+      (registry == nullptr || registry->exists(item_name, true) ||
+       !registry->findExternal(item_name, uuid, stats))
+          ? nullptr
+          : get().getTransport(uuid);
+  if (transport == nullptr) {
+    // Local items have no round trip to save.
+    for (const auto& request : requests) {
+      results.emplace_back();
+      results.back().status =
+          call(registry_name, item_name, request, results.back().response);
+    }
+    return results;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  try {
+    transport->callBatch(registry_name, item_name, requests, results);
+  } catch (const std::exception& e) {
+    results.resize(requests.size(), {Status(1, e.what()), {}});
+  }
+  results.resize(
+      requests.size(),
+      {Status(1, STATUS_LITERAL("Extension did not answer the request")), {}});
+
+  if (stats != 0 && PluginStats::get().enabled() && !requests.empty()) {
+    // Each request is counted as a call taking its share of the batch.
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count() /
+                   requests.size();
+    for (size_t i = 0; i < requests.size(); i++) {
+      size_t response_bytes = 0;
+      for (const auto& row : results[i].response) {
+        response_bytes += pluginRequestBytes(row);
+      }
+      PluginStats::count(stats);
+      PluginStats::get().record(stats,
+                                elapsed,
+                                !results[i].status.ok(),
+                                pluginRequestBytes(requests[i]),
+                                response_bytes);
+    }
+  }
+  return results;
+}
+
+/// Batches buffered between a streaming table and its consumer.
+const size_t kTableStreamBatches = 2;
+
+/// How long a streaming call waits for a worker before generating inline.
+const std::chrono::milliseconds kTableStreamClaimTimeout(5);
+
+/// How long setUp waits for workers before running queued items inline.
+const std::chrono::milliseconds kSetUpClaimTimeout(5);
+
 Status RegistryFactory::callTable(const std::string& table_name,
                                   QueryContext& context,
                                   PluginResponse& response) {
-  return Status(0, "OK");
+  // Materialize using a single unbounded batch.
+  return callTable(table_name,
+                   context,
+                   std::numeric_limits<size_t>::max(),
+                   [&response](QueryData& batch) {
+                     response.insert(response.end(),
+                                     std::make_move_iterator(batch.begin()),
+                                     std::make_move_iterator(batch.end()));
+                     return Status(0, "OK");
+                   });
+}
+
+Status RegistryFactory::callTable(
+    const std::string& table_name,
+    QueryContext& context,
+    size_t batch_size,
+    std::function<Status(QueryData& batch)> consumer) {
+  auto registry = get().find("table");
+  if (registry == nullptr || !registry->exists(table_name, true)) {
+    return Status(1, STATUS_LITERAL("Cannot call table: "), table_name);
+  }
+
+  std::shared_ptr<TablePlugin> table;
+  try {
+    table = get().typedPlugin<TablePlugin>("table", table_name);
+  } catch (const std::exception& e) {
+    return Status(1, e.what());
+  }
+  if (table == nullptr) {
+    return Status(1, STATUS_LITERAL("Not a table plugin: "), table_name);
+  }
+
+  // Count the rows handed to the consumer, the request is a QueryContext.
+  size_t stats = 0;
+  {
+    EpochDomain::ReadSection section;
+    auto item = registry->findItem(table_name);
+    stats = (item == nullptr) ? 0 : registry->statsId(*item);
+  }
+  PluginCallTimer timer(stats);
+  size_t response_bytes = 0;
+  if (timer.recording()) {
+    consumer = [consumer, &response_bytes](QueryData& batch) {
+      for (const auto& row : batch) {
+        response_bytes += pluginRequestBytes(row);
+      }
+      return consumer(batch);
+    };
+  }
+
+  // The generator must always be stopped and joined, even if the consumer
+  // throws, so a throw is reported as the consumer's failure.
+  auto consume = [&consumer](QueryData& batch) {
+    try {
+      return consumer(batch);
+    } catch (const std::exception& e) {
+      return Status(
+          1, STATUS_LITERAL("Table stream consumer failed: "), e.what());
+    } catch (...) {
+      return Status(1, STATUS_LITERAL("Table stream consumer failed"));
+    }
+  };
+
+  struct Stream {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<QueryData> batches;
+    std::atomic<bool> claimed{false};
+    bool stopped{false};
+    bool done{false};
+    Status status;
+  };
+
+  auto stream = std::make_shared<Stream>();
+  auto generate = [stream, table, &context, batch_size](
+                      TableRowWriter::Sink sink) {
+    TableRowWriter writer(batch_size, std::move(sink));
+    Status status;
+    try {
+      status = table->stream(context, writer);
+    } catch (const std::exception& e) {
+      status = Status(1, e.what());
+    } catch (...) {
+      status = Status(2, STATUS_LITERAL("Unknown exception"));
+    }
+    writer.finish();
+
+    std::lock_guard<std::mutex> lock(stream->mutex);
+    stream->status = status;
+    stream->done = true;
+    stream->condition.notify_all();
+  };
+
+  Executor::get().submit([stream, generate]() {
+    bool expected = false;
+    if (!stream->claimed.compare_exchange_strong(expected, true)) {
+      return;
+    }
+
+    generate([stream](QueryData& batch) {
+      std::unique_lock<std::mutex> lock(stream->mutex);
+      stream->condition.wait(lock, [&stream]() {
+        return stream->stopped ||
+               stream->batches.size() < kTableStreamBatches;
+      });
+      if (stream->stopped) {
+        return Status(1, STATUS_LITERAL("Table stream stopped by consumer"));
+      }
+      stream->batches.push_back(std::move(batch));
+      stream->condition.notify_all();
+      return Status(0, "OK");
+    });
+  });
+
+  Status consumer_status(0, "OK");
+  std::unique_lock<std::mutex> lock(stream->mutex);
+  while (true) {
+    auto ready = stream->condition.wait_for(
+        lock, kTableStreamClaimTimeout, [&stream]() {
+          return stream->done || !stream->batches.empty();
+        });
+
+    bool expected = false;
+    if (!ready && stream->claimed.compare_exchange_strong(expected, true)) {
+      // No worker is available, generate here and consume inline.
+      lock.unlock();
+      generate([&consume, &consumer_status](QueryData& batch) {
+        consumer_status = consume(batch);
+        return consumer_status;
+      });
+      lock.lock();
+      break;
+    }
+
+    if (!stream->batches.empty()) {
+      auto batch = std::move(stream->batches.front());
+      stream->batches.pop_front();
+      stream->condition.notify_all();
+
+      lock.unlock();
+      if (consumer_status.ok()) {
+        consumer_status = consume(batch);
+      }
+      lock.lock();
+
+      if (!consumer_status.ok()) {
+        stream->stopped = true;
+        stream->batches.clear();
+        stream->condition.notify_all();
+      }
+    } else if (stream->done) {
+      break;
+    }
+  }
+
+  // The generator references context, it must finish before returning.
+  stream->condition.wait(lock, [&stream]() { return stream->done; });
+  auto status = (consumer_status.ok()) ? stream->status : consumer_status;
+  timer.finish(status.ok(), 0, response_bytes);
+  return status;
+}
+
+Status RegistryFactory::callTable(
+    const std::string& table_name,
+    QueryContext& context,
+    size_t batch_size,
+    std::function<Status(RowBatch& batch)> consumer) {
+  auto dictionary = std::make_shared<const ColumnDictionary>();
+  return callTable(table_name,
+                   context,
+                   batch_size,
+                   [&consumer, &dictionary](QueryData& rows) {
+                     RowBatch batch(dictionary);
+                     for (const auto& row : rows) {
+                       auto status = batch.addRow(row);
+                       if (!status.ok()) {
+                         return status;
+                       }
+                     }
+                     QueryData().swap(rows);
+
+                     // Later batches start with every column seen so far.
+                     dictionary = batch.dictionary();
+                     return consumer(batch);
+                   });
 }
 
 Status RegistryFactory::setActive(const std::string& registry_name,
                                   const std::string& item_name) {
+  auto registry = tryRegistry(registry_name);
+  if (!registry) {
+    return registry.getStatus();
+  }
   WriteLock lock(mutex_);
-  return registry(registry_name)->setActive(item_name);
+  return (*registry)->setActive(item_name);
 }
 
 std::string RegistryFactory::getActive(const std::string& registry_name) const {
   return registry(registry_name)->getActive();
 }
 
+namespace {
+
+/// A single plugin's setUp, shared between the waiter and a worker.
+struct PluginSetUp {
+  RegistryInterface* registry{nullptr};
+  std::string name;
+  PluginRef plugin;
+
+  /// Failed active plugins are kept, as the registry has no alternative.
+  bool removable{true};
+
+  /// The remaining state is protected by PluginSetUps::mutex.
+  bool started{false};
+  bool finished{false};
+  bool abandoned{false};
+  std::chrono::steady_clock::time_point start;
+  std::chrono::microseconds duration{0};
+  Status status;
+};
+
+struct PluginSetUps {
+  std::vector<std::unique_ptr<PluginSetUp>> items;
+  std::mutex mutex;
+  std::condition_variable condition;
+};
+
+/// Run an item's setUp unless a worker or the waiter already started it.
+void runSetUp(PluginSetUps& setups, PluginSetUp& setup) {
+  {
+    std::lock_guard<std::mutex> lock(setups.mutex);
+    if (setup.started) {
+      return;
+    }
+    setup.started = true;
+    setup.start = std::chrono::steady_clock::now();
+  }
+
+  Status status;
+  try {
+    status = setup.plugin->setUp();
+  } catch (const std::exception& e) {
+    status = Status(1, e.what());
+  } catch (...) {
+    status = Status(2, STATUS_LITERAL("Unknown exception"));
+  }
+
+  std::unique_lock<std::mutex> lock(setups.mutex);
+  setup.finished = true;
+  if (setup.abandoned) {
+    // The waiter gave up and removed the item without a tearDown.
+    lock.unlock();
+    setup.plugin->tearDown();
+    return;
+  }
+  setup.status = status;
+  setup.duration = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - setup.start);
+  setups.condition.notify_all();
+}
+}
+
+void RegistryFactory::setUpRegistries(
+    const std::vector<RegistryInterface*>& wave) {
+  auto setups = std::make_shared<PluginSetUps>();
+  for (auto registry : wave) {
+    // If this registry does not auto-setup do NOT setup the registry items.
+    if (!registry->auto_setup_) {
+      continue;
+    }
+
+    // Items not yet constructed are set up when first used.
+    registry->set_up_.store(true, std::memory_order_release);
+
+    // If the registry is using a single 'active' plugin, setUp that plugin.
+    // For config and logger, only setUp the selected plugin.
+    std::lock_guard<RecursiveMutex> lock(registry->mutex_);
+    auto active = (registry->active_.empty())
+                      ? false
+                      : registry->items_.count(registry->active_) > 0;
+    for (const auto& item : registry->items_) {
+      if (active && item.first != registry->active_) {
+        continue;
+      }
+
+      if (!RegistryInterface::constructed(*item.second)) {
+        continue;
+      }
+
+      std::unique_ptr<PluginSetUp> setup(new PluginSetUp());
+      setup->registry = registry;
+      setup->name = item.first;
+      setup->plugin = item.second->plugin;
+      setup->removable = !active;
+      setups->items.push_back(std::move(setup));
+    }
+  }
+
+  for (size_t i = 0; i < setups->items.size(); i++) {
+    Executor::get().submit(
+        [setups, i]() { runSetUp(*setups, *setups->items[i]); });
+  }
+
+  // Wait for every item, a timeout only applies once an item has started.
+  auto timeout = get().setup_timeout_;
+  auto claim_deadline = std::chrono::steady_clock::now() + kSetUpClaimTimeout;
+  std::unique_lock<std::mutex> lock(setups->mutex);
+  while (true) {
+    if (std::chrono::steady_clock::now() >= claim_deadline) {
+      // No worker took these promptly, the waiter may itself be a worker.
+      for (auto& setup : setups->items) {
+        if (setup->started) {
+          continue;
+        }
+        lock.unlock();
+        runSetUp(*setups, *setup);
+        lock.lock();
+        if (timeout.count() > 0 && setup->duration > timeout) {
+          // It could not be abandoned while it ran on this thread.
+          setup->status = Status(
+              1, STATUS_LITERAL("Plugin setUp timed out: "), setup->name);
+        }
+      }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    auto next_deadline = std::chrono::steady_clock::time_point::max();
+    bool waiting = false;
+    for (auto& setup : setups->items) {
+      if (setup->finished || setup->abandoned) {
+        continue;
+      }
+
+      if (setup->started && timeout.count() > 0) {
+        auto deadline = setup->start + timeout;
+        if (now >= deadline) {
+          setup->abandoned = true;
+          setup->status = Status(
+              1, STATUS_LITERAL("Plugin setUp timed out: "), setup->name);
+          setup->duration =
+              std::chrono::duration_cast<std::chrono::microseconds>(timeout);
+          continue;
+        }
+        next_deadline = std::min(next_deadline, deadline);
+      } else if (!setup->started) {
+        next_deadline = std::min(next_deadline, claim_deadline);
+      }
+      waiting = true;
+    }
+
+    if (!waiting) {
+      break;
+    }
+
+    if (next_deadline == std::chrono::steady_clock::time_point::max()) {
+      setups->condition.wait(lock);
+    } else {
+      setups->condition.wait_until(lock, next_deadline);
+    }
+  }
+
+  // Record durations and remove failures from the waiting thread only.
+  std::vector<PluginSetUp*> failed;
+  std::vector<std::pair<PluginSetUp*, std::chrono::microseconds>> durations;
+  for (auto& setup : setups->items) {
+    durations.emplace_back(setup.get(), setup->duration);
+    if (!setup->status.ok() && setup->removable) {
+      failed.push_back(setup.get());
+    }
+  }
+  lock.unlock();
+
+  for (const auto& duration : durations) {
+    auto registry = duration.first->registry;
+    std::lock_guard<RecursiveMutex> registry_lock(registry->mutex_);
+    registry->setup_durations_[duration.first->name] = duration.second;
+  }
+
+  for (auto setup : failed) {
+    setup->registry->remove(setup->name, !setup->abandoned);
+  }
+}
+
 void RegistryFactory::setUp() {
-  for (const auto& registry : get().all()) {
-    registry.second->setUp();
+  auto& rf = get();
+  std::map<std::string, std::set<std::string>> dependencies;
+  {
+    ReadLock lock(rf.mutex_);
+    dependencies = rf.setup_dependencies_;
+  }
+
+  // Iterate the current snapshot in place rather than copying every registry.
+  EpochDomain::ReadSection section;
+  const auto& registries =
+      rf.registries_.load(std::memory_order_acquire)->registries;
+
+  std::set<std::string> remaining;
+  for (const auto& registry : registries) {
+    remaining.insert(registry.first);
+  }
+
+  while (!remaining.empty()) {
+    std::vector<std::string> ready;
+    for (const auto& name : remaining) {
+      bool blocked = false;
+      for (const auto& dependency : dependencies[name]) {
+        if (remaining.count(dependency) > 0) {
+          blocked = true;
+          break;
+        }
+      }
+      if (!blocked) {
+        ready.push_back(name);
+      }
+    }
+
+    if (ready.empty()) {
+      // A dependency cycle, set up the rest together rather than stall.
+      ready.assign(remaining.begin(), remaining.end());
+    }
+
+    std::vector<RegistryInterface*> wave;
+    for (const auto& name : ready) {
+      wave.push_back(registries.at(name).get());
+      remaining.erase(name);
+    }
+    setUpRegistries(wave);
   }
 }
 
+void RegistryFactory::addSetUpDependency(const std::string& registry_name,
+                                         const std::string& depends_on) {
+  WriteLock lock(mutex_);
+  setup_dependencies_[registry_name].insert(depends_on);
+}
+
+std::map<std::string, std::map<std::string, std::chrono::microseconds>>
+RegistryFactory::getSetUpDurations() const {
+  std::map<std::string, std::map<std::string, std::chrono::microseconds>>
+      durations;
+  EpochDomain::ReadSection section;
+  for (const auto& registry :
+       registries_.load(std::memory_order_acquire)->registries) {
+    durations[registry.first] = registry.second->getSetUpDurations();
+  }
+  return durations;
+}
+
 bool RegistryFactory::exists(const std::string& registry_name,
                              const std::string& item_name,
                              bool local) const {
-  if (!exists(registry_name)) {
+  auto registry = tryRegistry(registry_name);
+  if (!registry) {
     return false;
   }
 
   // Check the registry.
-  return registry(registry_name)->exists(item_name, local);
+  return (*registry)->exists(item_name, local);
 }
 
 std::vector<std::string> RegistryFactory::names() const {
   std::vector<std::string> names;
-  for (const auto& registry : all()) {
+  EpochDomain::ReadSection section;
+  for (const auto& registry :
+       registries_.load(std::memory_order_acquire)->registries) {
     names.push_back(registry.second->getName());
   }
   return names;
@@ -391,11 +1831,11 @@ std::vector<std::string> RegistryFactory::names() const {
 
 std::vector<std::string> RegistryFactory::names(
     const std::string& registry_name) const {
-  if (registries_.at(registry_name) == 0) {
-    std::vector<std::string> names;
-    return names;
+  auto registry = tryRegistry(registry_name);
+  if (!registry) {
+    return std::vector<std::string>();
   }
-  return registry(registry_name)->names();
+  return (*registry)->names();
 }
 
 std::vector<RouteUUID> RegistryFactory::routeUUIDs() const {
@@ -403,78 +1843,276 @@ std::vector<RouteUUID> RegistryFactory::routeUUIDs() const {
 }
 
 size_t RegistryFactory::count(const std::string& registry_name) const {
-  if (!exists(registry_name)) {
+  auto registry = tryRegistry(registry_name);
+  if (!registry) {
     return 0;
   }
-  return registry(registry_name)->count();
+  return (*registry)->count();
 }
 
 std::map<RouteUUID, ModuleInfo> RegistryFactory::getModules() const {
+  ReadLock lock(modules_mutex_);
   return modules_;
 }
 
 RouteUUID RegistryFactory::getModule() {
-  return module_uuid_;
+  auto module = current_module;
+  return (module != nullptr && module->committing) ? module->uuid : 0;
 }
 
 bool RegistryFactory::usingModule() {
-  // Check if the registry is allowing a module's registrations.
-  return (!locked() && module_uuid_ != 0);
+  return getModule() != 0;
 }
 
-void RegistryFactory::shutdownModule() {
-  locked(true);
-  module_uuid_ = 0;
+RouteUUID RegistryFactory::initModule(const std::string& path) {
+  WriteLock lock(modules_mutex_);
+  // A counter, not a random ID: concurrent loads can never collide.
+  auto uuid = ++last_module_;
+  modules_[uuid].path = path;
+  return uuid;
 }
 
-void RegistryFactory::initModule(const std::string& path) {
-  // Begin a module initialization, lock until the module is determined
-  // appropriate by requesting a call to `declareModule`.
-  module_uuid_ = (RouteUUID)rand();
-  modules_[getModule()].path = path;
-  locked(true);
+void RegistryFactory::removeModule(const RouteUUID& uuid) {
+  WriteLock lock(modules_mutex_);
+  modules_.erase(uuid);
+}
+
+void RegistryFactory::rollbackModule(const RouteUUID& uuid,
+                                     const std::set<std::string>& registries) {
+  for (const auto& registry : all()) {
+    std::vector<std::string> items;
+    {
+      std::lock_guard<RecursiveMutex> lock(registry.second->mutex_);
+      for (const auto& module : registry.second->modules_) {
+        if (module.second == uuid) {
+          items.push_back(module.first);
+        }
+      }
+    }
+    for (const auto& item : items) {
+      registry.second->remove(item);
+      std::lock_guard<RecursiveMutex> lock(registry.second->mutex_);
+      registry.second->modules_.erase(item);
+    }
+  }
+
+  WriteLock lock(mutex_);
+  auto current = registries_.load(std::memory_order_acquire);
+  auto next = new RegistrySnapshot();
+  for (const auto& registry : current->registries) {
+    if (registries.count(registry.first) > 0) {
+      removed_registries_.push_back(registry.second);
+      continue;
+    }
+    next->index[registry.first] = registry.second.get();
+    next->registries.insert(registry);
+  }
+  registries_.store(next, std::memory_order_release);
+  EpochDomain::get().retire(current);
 }
 
 void RegistryFactory::declareModule(const std::string& name,
                                     const std::string& version,
                                     const std::string& min_sdk_version,
                                     const std::string& sdk_version) {
+  auto module = stagingModule();
+  if (module == nullptr) {
+    return;
+  }
+
+  module->info.name = name;
+  module->info.version = version;
+  module->info.sdk_version = sdk_version;
+
   // Check the min_sdk_version against the Registry's SDK version.
-  auto& module = modules_[module_uuid_];
-  module.name = name;
-  module.version = version;
-  module.sdk_version = sdk_version;
-  locked(false);
+  if (sdkVersionAtLeast(OSQUERY_REGISTRY_SDK_VERSION, min_sdk_version)) {
+    module->declaration = Status(0, "OK");
+  } else {
+    module->declaration =
+        Status(1, "Module " + name + " requires SDK " + min_sdk_version);
+  }
 }
 
 RegistryModuleLoader::RegistryModuleLoader(const std::string& path)
-    : handle_(nullptr), path_(path) {
-  // Tell the registry that we are attempting to construct a module.
-  // Locking the registry prevents the module's global initialization from
-  // adding or creating registry items.
+    : handle_(nullptr), path_(path), stage_(new ModuleStage()) {
+  stage_->uuid = RegistryFactory::get().initModule(path);
+  stage_->info.path = path;
+
+#ifndef WIN32
+  // The module's static initializers run here, on this thread.
+  ModuleScope scope(*stage_);
+  handle_ = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
 }
 
-void RegistryModuleLoader::init() {
-  if (handle_ == nullptr || RegistryFactory::get().locked()) {
-    handle_ = nullptr;
-    return;
+Status RegistryModuleLoader::declare() {
+  if (handle_ == nullptr) {
+    return Status(1, STATUS_LITERAL("Cannot open module: "), path_);
+  }
+
+  ModuleInitalizer initializer = nullptr;
+#ifndef WIN32
+  initializer =
+      reinterpret_cast<ModuleInitalizer>(dlsym(handle_, "initModule"));
+#endif
+  if (initializer == nullptr) {
+    return Status(
+        1, STATUS_LITERAL("Module does not export initModule: "), path_);
+  }
+
+  ModuleScope scope(*stage_);
+  try {
+    initializer();
+  } catch (const std::exception& e) {
+    return Status(1, e.what());
   }
+  return stage_->declaration;
 }
 
-RegistryModuleLoader::~RegistryModuleLoader() {
+Status RegistryModuleLoader::commit() {
   auto& rf = RegistryFactory::get();
-  if (handle_ == nullptr) {
+  WriteLock lock(rf.modules_mutex_);
+
+  // Check every registration first, a module is committed whole or not at
+  // all.
+  std::set<std::string> registries;
+  std::set<std::pair<std::string, std::string>> items;
+  auto add_registry = [&](const std::string& type) {
+    if (rf.exists(type) || !registries.insert(type).second) {
+      return Status(1, STATUS_LITERAL("Cannot add duplicate registry: "), type);
+    }
+    return Status(0, "OK");
+  };
+  auto add_item = [&](const std::string& type, const std::string& name) {
+    if (registries.count(type) == 0 && !rf.exists(type)) {
+      return Status(1, STATUS_LITERAL("Unknown registry requested: "), type);
+    }
+    if (rf.exists(type, name, true) || !items.emplace(type, name).second) {
+      return Status(
+          1, STATUS_LITERAL("Duplicate registry item exists: "), name);
+    }
+    return Status(0, "OK");
+  };
+
+  Status status;
+  for (const auto& it : stage_->registries) {
+    status = status.ok() ? add_registry(it.type) : status;
+  }
+  for (const auto& it : stage_->dynamic_registries) {
+    status = status.ok() ? add_registry(it->type_) : status;
+  }
+  for (const auto& it : stage_->plugins) {
+    status = status.ok() ? add_item(it.type, it.name) : status;
+  }
+  for (const auto& it : stage_->dynamic_plugins) {
+    status = status.ok() ? add_item(it->type_, it->name_) : status;
+  }
+  if (!status.ok()) {
+    return status;
+  }
+
+  // Items added while committing are attributed to this module.
+  ModuleScope scope(*stage_);
+  stage_->committing = true;
+  try {
+    registerRegistries(stage_->registries.data(),
+                       stage_->registries.data() + stage_->registries.size());
+    for (const auto& it : stage_->dynamic_registries) {
+      it->run();
+    }
+    status = registerPlugins(stage_->plugins.data(),
+                             stage_->plugins.data() + stage_->plugins.size());
+    for (const auto& it : stage_->dynamic_plugins) {
+      auto added = it->run();
+      status = status.ok() ? added : status;
+    }
+  } catch (const std::exception& e) {
+    status = Status(1, STATUS_LITERAL("Cannot commit module: "), e.what());
+  }
+  stage_->committing = false;
+
+  if (!status.ok()) {
+    // Nothing of a module is left registered if any part fails.
+    rf.rollbackModule(stage_->uuid, registries);
+    return status;
+  }
+
+  rf.modules_[stage_->uuid] = stage_->info;
+  committed_ = true;
+  return Status(0, "OK");
+}
+
+Status RegistryModuleLoader::init() {
+  auto status = declare();
+  if (status.ok()) {
+    status = commit();
+  }
+  return status;
+}
+
+size_t RegistryModuleLoader::loadDirectory(const std::string& directory) {
+  std::vector<std::string> paths;
+#ifndef WIN32
+  auto dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    return 0;
+  }
+#ifdef __APPLE__
+  const std::string extension = ".dylib";
+#else
+  const std::string extension = ".so";
+#endif
+  while (auto entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name.size() > extension.size() &&
+        name.compare(name.size() - extension.size(),
+                     extension.size(),
+                     extension) == 0) {
+      paths.push_back(directory + "/" + name);
+    }
+  }
+  closedir(dir);
+#endif
+  std::sort(paths.begin(), paths.end());
+
+  // Opening and declaring is independent per module.
+  std::vector<std::unique_ptr<RegistryModuleLoader>> loaders(paths.size());
+  std::vector<Status> declared(paths.size());
+  {
+    TaskGroup group;
+    for (size_t i = 0; i < paths.size(); i++) {
+      group.run([&paths, &loaders, &declared, i]() {
+        try {
+          loaders[i].reset(new RegistryModuleLoader(paths[i]));
+          declared[i] = loaders[i]->declare();
+        } catch (const std::exception& e) {
+          // A module that fails to open must not stop its siblings.
+          declared[i] = Status(
+              1, STATUS_LITERAL("Cannot load module: "), e.what());
+        }
+      });
+    }
+    group.wait();
+  }
+
+  size_t loaded = 0;
+  for (size_t i = 0; i < paths.size(); i++) {
+    if (declared[i].ok() && loaders[i]->commit().ok()) {
+      loaded++;
+    }
+  }
+  return loaded;
+}
+
+RegistryModuleLoader::~RegistryModuleLoader() {
+  if (!committed_) {
     // The module was not loaded or did not initalize.
-    rf.modules_.erase(rf.getModule());
+    RegistryFactory::get().removeModule(stage_->uuid);
   }
 
   // We do not close the module, and thus are OK with losing a reference to the
   // module's handle. Attempting to close and clean up is very expensive for
   // very little value/features.
-  if (!rf.locked()) {
-    rf.shutdownModule();
-  }
-  // No need to clean this resource.
   handle_ = nullptr;
 }
 
@@ -501,11 +2139,46 @@ void Plugin::setResponse(const std::string& key,
   }
   response.push_back({{key, output.str()}});
 }
+
+Status AsyncPlugin::call(const PluginRequest& request,
+                         PluginResponse& response) {
+  struct Wait {
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool complete{false};
+    Status status;
+    PluginResponse response;
+  };
+
+  // The completion may outlive this frame if the plugin invokes it late.
+  auto wait = std::make_shared<Wait>();
+  callAsync(request, [wait](Status status, PluginResponse result) {
+    std::lock_guard<std::mutex> lock(wait->mutex);
+    if (!wait->complete) {
+      wait->status = std::move(status);
+      wait->response = std::move(result);
+      wait->complete = true;
+      wait->condition.notify_all();
+    }
+  });
+
+  std::unique_lock<std::mutex> lock(wait->mutex);
+  wait->condition.wait(lock, [&wait]() { return wait->complete; });
+  response.insert(response.end(),
+                  std::make_move_iterator(wait->response.begin()),
+                  std::make_move_iterator(wait->response.end()));
+  return wait->status;
+}
 }
 
+#ifndef OSQUERY_BENCHMARKS
 int main(int argc, const char *argv[]) {
     std::cout << "Starting it up...\n" << std::endl;
-    osquery::registryAndPluginInit();
+    auto status = osquery::registryAndPluginInit();
+    if (!status.ok()) {
+      std::cout << "Registration failed: " << status << std::endl;
+    }
     std::cout << "Finishing...\n" << std::endl;
 }
+#endif
 
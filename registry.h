@@ -10,15 +10,25 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <map>
 #include <mutex>
 #include <set>
+#include <type_traits>
+#include <typeinfo>
 #include <vector>
 
 #include <boost/noncopyable.hpp>
 #include <boost/property_tree/ptree.hpp>
 
 #include <core.h>
+#include <epoch.h>
+#include <flat_index.h>
+#include <plugin_record.h>
+#include <plugin_stats.h>
+#include <published_index.h>
 
 namespace osquery {
 
@@ -41,18 +51,34 @@ using PluginRequest = std::map<std::string, std::string>;
  */
 using PluginResponse = std::vector<PluginRequest>;
 
+/**
+ * @brief Completes an asynchronous plugin call, see Plugin::callAsync.
+ *
+ * A completion must be invoked exactly once and may be invoked from any
+ * thread.
+ */
+using PluginCompletion =
+    std::function<void(Status status, PluginResponse response)>;
+
 /// Registry routes are a map of item name to each optional PluginReponse.
 using RegistryRoutes = std::map<std::string, PluginResponse>;
 
 /// An extension or core's broadcast includes routes from every Registry.
 using RegistryBroadcast = std::map<std::string, RegistryRoutes>;
 
-using RouteUUID = uint64_t;
+/// A registry's route changes since some broadcast generation.
+struct RegistryRoutesDelta {
+  /// Routes added or changed, with their current route info.
+  RegistryRoutes added;
+
+  /// Names that are no longer broadcast.
+  std::vector<std::string> removed;
+};
 
-using AddExternalCallback =
-    std::function<Status(const std::string&, const PluginResponse&)>;
+/// Route changes for every registry that changed, see getBroadcastDelta.
+using RegistryBroadcastDelta = std::map<std::string, RegistryRoutesDelta>;
 
-using RemoveExternalCallback = std::function<void(const std::string&)>;
+using RouteUUID = uint64_t;
 
 /// When a module is being initialized its information is kept in a transient
 /// RegistryFactory lookup location.
@@ -66,9 +92,15 @@ struct ModuleInfo {
 /// The call-in prototype for Registry modules.
 using ModuleInitalizer = void (*)(void);
 
+/// A module's registrations, held until the module's declaration is accepted.
+struct ModuleStage;
+
 /// The registry includes a single optimization for table generation.
 struct QueryContext;
 
+/// A columnar batch of table rows, see query_batch.h.
+class RowBatch;
+
 class Plugin : private boost::noncopyable {
  public:
   virtual ~Plugin() {}
@@ -106,6 +138,33 @@ class Plugin : private boost::noncopyable {
   virtual Status call(const PluginRequest& request,
                       PluginResponse& response) = 0;
 
+  /**
+   * @brief Call the plugin using a flat PluginRecord request.
+   *
+   * Plugins may override this to read the request without building a
+   * PluginRequest map. The default adapts the record and forwards to call,
+   * which costs more than building the map in the first place.
+   */
+  virtual Status callRecord(const PluginRecord& request,
+                            PluginResponse& response) {
+    return call(request.toMap(), response);
+  }
+
+  /**
+   * @brief Start a call that completes by invoking done.
+   *
+   * The default runs call on the calling thread. I/O bound plugins should
+   * derive from AsyncPlugin, which starts the I/O and returns immediately.
+   *
+   * @param request Valid until done is invoked.
+   * @param done Invoked exactly once with the call's status and response.
+   */
+  virtual void callAsync(const PluginRequest& request, PluginCompletion done) {
+    PluginResponse response;
+    auto status = call(request, response);
+    done(std::move(status), std::move(response));
+  }
+
   /// Allow the plugin to introspect into the registered name (for logging).
   virtual void setName(const std::string& name) final {
     name_ = name;
@@ -152,6 +211,31 @@ class Plugin : private boost::noncopyable {
 /// Helper definition for a shared pointer to a Plugin.
 using PluginRef = std::shared_ptr<Plugin>;
 
+/// Constructs a registered plugin on first use.
+using PluginFactory = PluginRef (*)();
+
+/**
+ * @brief A plugin that does not block a thread while its call waits on I/O.
+ *
+ * C++14 has no coroutines, so an asynchronous plugin is written in
+ * continuation-passing style: callAsync starts the work, returns, and the
+ * I/O's completion handler invokes done. Each suspension point is a
+ * callback; CPU-heavy continuations should be resubmitted to the Executor
+ * rather than run on an I/O thread.
+ *
+ * RegistryFactory::callAsync keeps many such calls in flight on the shared
+ * Executor without holding a worker per call. The synchronous call is
+ * implemented by waiting for the completion.
+ */
+class AsyncPlugin : public Plugin {
+ public:
+  void callAsync(const PluginRequest& request,
+                 PluginCompletion done) override = 0;
+
+  /// Start the call and block the calling thread until it completes.
+  Status call(const PluginRequest& request, PluginResponse& response) final;
+};
+
 /**
  * @brief This is the registry interface.
  */
@@ -175,6 +259,23 @@ class RegistryInterface : private boost::noncopyable {
                      const PluginRef& plugin_item,
                      bool internal = false) = 0;
 
+  /**
+   * @brief Add a plugin that is constructed when first used.
+   *
+   * The factory runs exactly once, when plugin, call, or setActive first
+   * touches the item. If the registry was already set up the new plugin is
+   * also set up. Most registered plugins are never used and cost only this
+   * registration. The item's route is broadcast once it is constructed, and
+   * an item that fails to construct or set up is removed.
+   *
+   * @param plugin_name An indexable name for the plugin.
+   * @param factory Constructs the plugin, which must be of the registry type.
+   * @param internal true if this is internal to the osquery SDK.
+   */
+  Status addFactory(const std::string& plugin_name,
+                    PluginFactory factory,
+                    bool internal = false);
+
   /**
    * @brief Remove a registry item by its identifier.
    *
@@ -189,9 +290,7 @@ class RegistryInterface : private boost::noncopyable {
   bool isInternal(const std::string& item_name) const;
 
   /// Allow others to introspect into the routes from extensions.
-  const std::map<std::string, RouteUUID>& getExternal() const {
-    return external_;
-  }
+  std::map<std::string, RouteUUID> getExternal() const;
 
   /// Get the 'active' plugin, return success with the active plugin name.
   const std::string& getActive() const {
@@ -203,11 +302,17 @@ class RegistryInterface : private boost::noncopyable {
     return name_;
   }
 
+  /// The plugin type of this registry, every item is at least this type.
+  const std::type_info& pluginType() const {
+    return *plugin_type_;
+  }
+
   /// Facility method to check if a registry item exists.
   bool exists(const std::string& item_name, bool local = false) const;
 
   /// Facility method to count the number of items in this registry.
   size_t count() const {
+    std::lock_guard<RecursiveMutex> lock(mutex_);
     return items_.size();
   }
 
@@ -224,15 +329,20 @@ class RegistryInterface : private boost::noncopyable {
    *
    * The registry `setUp` will iterate over all of its registry items and call
    * their setup unless the registry is lazy (see CREATE_REGISTRY).
+   *
+   * Items are set up concurrently on the shared Executor. Items that fail,
+   * or exceed RegistryFactory::setUpTimeout, are removed. Items added by
+   * factory and not yet used are set up when they are constructed.
    */
   virtual void setUp();
 
+  /// How long each item's most recent setUp took.
+  std::map<std::string, std::chrono::microseconds> getSetUpDurations() const;
+
   virtual PluginRef plugin(const std::string& plugin_name) const = 0;
 
   /// Construct and return a map of plugin names to their implementation.
-  const std::map<std::string, PluginRef>& plugins() {
-    return items_;
-  }
+  std::map<std::string, PluginRef> plugins();
 
   /**
    * @brief Create a routes table for this registry.
@@ -247,6 +357,51 @@ class RegistryInterface : private boost::noncopyable {
    */
   RegistryRoutes getRoutes() const;
 
+  /// A registry's route table and its encoding, see getRoutesCache.
+  struct RoutesCache {
+    RegistryRoutes routes;
+
+    /// The routes encoded by encodeRoutes.
+    std::string encoded;
+
+    /// The route version the table was computed at.
+    size_t version{0};
+  };
+
+  /**
+   * @brief The memoized route table.
+   *
+   * Routes are computed, calling each plugin's routeInfo, on first use after
+   * items, aliases, or external routes change. Items added by factory are not
+   * constructed for their routes, they are included once constructed. Until
+   * the next change every caller shares the same table, getRoutes returns a
+   * copy of it.
+   */
+  std::shared_ptr<const RoutesCache> getRoutesCache() const;
+
+  /**
+   * @brief Get a single broadcast route.
+   *
+   * @param name An item name or alias, as it appears in getRoutes.
+   * @param route Output, the route info if the name is broadcast.
+   * @return false if getRoutes would not include the name.
+   */
+  bool getRoute(const std::string& name, PluginResponse& route) const;
+
+  /// Routes added, changed, or removed after a broadcast generation.
+  RegistryRoutesDelta getRoutesDelta(size_t since) const;
+
+  /**
+   * @brief A counter bumped whenever a resolved item may have become stale.
+   *
+   * Removing an item or adding/removing external routes changes what a name
+   * resolves to. Callers caching a resolved plugin compare generations
+   * instead of repeating the lookup.
+   */
+  size_t generation() const {
+    return generation_.load(std::memory_order_acquire);
+  }
+
  protected:
   /**
    * @brief The only method a plugin user should call.
@@ -330,6 +485,9 @@ class RegistryInterface : private boost::noncopyable {
   /// Get the registry item name for a given alias.
   std::string getAlias(const std::string& alias) const;
 
+  /// Check a plugin is of the registry's type before it is indexed.
+  virtual bool accepts(const Plugin& plugin) const = 0;
+
  protected:
   /// The identifier for this registry, used to register items.
   std::string name_;
@@ -337,22 +495,101 @@ class RegistryInterface : private boost::noncopyable {
   /// Does this registry run setUp on each registry item at initialization.
   bool auto_setup_;
 
+  /// Set by RegistryType, see pluginType.
+  const std::type_info* plugin_type_{&typeid(Plugin)};
+
  protected:
-  /// A map of registered plugin instances to their registered identifier.
-  std::map<std::string, PluginRef> items_;
+  /// A registered item, shared by every version of the index that lists it.
+  struct ItemEntry {
+    /// The registered identifier.
+    std::string name;
+
+    /// The plugin, set when added or by construction, see ready.
+    PluginRef plugin;
+
+    /// Constructs the plugin of an item added by factory, see addFactory.
+    PluginFactory create{nullptr};
+
+    std::once_flag once;
+
+    /// The plugin is set and may be read without the once flag.
+    std::atomic<bool> ready{false};
+
+    /// Why construction failed, set within the once flag and never retried.
+    Status failure;
+
+    /// PluginStats identifier of the item, see statsId.
+    PluginStatsId stats;
+
+    /// The item is internal and not broadcast.
+    bool internal{false};
+  };
+
+  using ItemEntryRef = std::shared_ptr<ItemEntry>;
+
+  /**
+   * @brief Each registered item by its registered identifier.
+   *
+   * This and the other item tables are protected by mutex_, calls use the
+   * published index_ instead.
+   */
+  std::map<std::string, ItemEntryRef> items_;
 
   /// If aliases are used, a map of alias to item name.
   std::map<std::string, std::string> aliases_;
 
-  /// Keep a lookup of the external item name to assigned extension UUID.
-  std::map<std::string, RouteUUID> external_;
+  /// The reverse of aliases_, each item name to the aliases that mask it.
+  std::multimap<std::string, std::string> item_aliases_;
+
+  /// An item name routed to an extension.
+  struct ExternalRoute {
+    /// The extension UUID that owns the name.
+    RouteUUID uuid{0};
+
+    /// Optional route info. The plugin may handle calls to external items
+    /// differently.
+    PluginResponse info;
+
+    /// PluginStats identifier of the route, assigned by findExternal.
+    PluginStatsId stats;
+  };
+
+  /**
+   * @brief The route of each external item name.
+   *
+   * Broadcasts add and remove routes while calls are probing them, so the
+   * routes are not kept in index_. Only the RegistryFactory changes routes,
+   * with its mutex and mutex_ held, and a change only visits the routes of
+   * one extension, see PublishedIndex.
+   */
+  PublishedIndex<ExternalRoute> externals_;
+
+  /// The external item names added by each extension UUID, a name may be
+  /// listed by a UUID that no longer owns it. Guarded by mutex_.
+  std::map<RouteUUID, std::vector<std::string>> external_items_;
+
+  /// The routes the last addExternal took over from other extensions.
+  std::map<std::string, ExternalRoute> displaced_;
+
+  /**
+   * @brief Copy the owner and stats identifier of an external route.
+   *
+   * @return false if the name is not routed to an extension.
+   */
+  bool findExternal(const std::string& item_name,
+                    RouteUUID& uuid,
+                    size_t& stats) const;
 
-  /// Keep a lookup of optional route info. The plugin may handle calls
-  /// to external items differently.
-  std::map<std::string, PluginResponse> routes_;
+  /**
+   * @brief Undo the last addExternal, for a broadcast that failed.
+   *
+   * Unlike removeExternal, a name the uuid took over is given back to the
+   * extension that owned it before.
+   */
+  void rollbackExternal(const RouteUUID& uuid);
 
-  /// Keep a lookup of registry items that are blacklisted from broadcast.
-  std::vector<std::string> internal_;
+  /// Remove the routes of a uuid, optionally restoring displaced routes.
+  void removeExternal(const RouteUUID& uuid, bool rollback);
 
   /// Support an 'active' mode where calls without a specific item name will
   /// be directed to the 'active' plugin.
@@ -361,6 +598,179 @@ class RegistryInterface : private boost::noncopyable {
   /// If a module was initialized/declared then store lookup information.
   std::map<std::string, RouteUUID> modules_;
 
+ protected:
+  /**
+   * @brief Everything a call-path lookup may want to know about a name.
+   *
+   * A slot holds its own copy of the name's state, so a published index
+   * never points into the item tables. Slots are immutable, a change
+   * publishes a new slot, see setSlot. A name may be an item and an alias at
+   * the same time, a single probe answers both. External routes are in
+   * externals_.
+   */
+  struct ItemSlot {
+    /// The item registered under the name, or nullptr.
+    ItemEntryRef item;
+
+    /// The aliased item name, empty if the name is not an alias.
+    std::string alias;
+
+    bool empty() const {
+      return item == nullptr && alias.empty();
+    }
+  };
+
+  /**
+   * @brief Hash index over items_ and aliases_.
+   *
+   * call, exists, plugin, callBatch, and resolve probe the index within an
+   * EpochDomain::ReadSection and without a lock. Changes are made in place,
+   * with mutex_ held, see PublishedIndex.
+   */
+  PublishedIndex<ItemSlot> index_;
+
+  /**
+   * @brief Find a local item, nullptr if there is none.
+   *
+   * The caller must be within an EpochDomain::ReadSection, the item is not
+   * reference counted and is only valid until the section ends. A removed
+   * item, and its plugin, outlive the read sections that found it.
+   */
+  ItemEntry* findItem(const std::string& item_name) const;
+
+  /// Publish a changed copy of a name's slot, an empty slot is erased.
+  template <typename Change>
+  void setSlot(const std::string& name, Change change) {
+    auto current = index_.find(name);
+    std::unique_ptr<ItemSlot> next(
+        (current == nullptr) ? new ItemSlot() : new ItemSlot(*current));
+    change(*next);
+    index_.set(name, next->empty() ? nullptr : next.release());
+  }
+
+  /**
+   * @brief The plugin for an item, constructing it on first use.
+   *
+   * Every read of an item's plugin must go through instance, construction
+   * failures are thrown, on the next use as well, see construct.
+   */
+  const PluginRef& instance(ItemEntry& item) const {
+    if (!item.ready.load(std::memory_order_acquire)) {
+      construct(item);
+    }
+    return item.plugin;
+  }
+
+  /**
+   * @brief Run a lazy item's factory, once, see instance.
+   *
+   * A foreign plugin or failed setUp is recorded and the item is removed.
+   * This and every later call through a held entry throw the recorded
+   * failure without constructing the plugin again.
+   */
+  void construct(ItemEntry& item) const;
+
+  /// Broadcast a newly constructed item, or remove one that failed.
+  void finishConstruct(const ItemEntry& item, bool failed);
+
+  /// The PluginStats identifier of an item, assigned on its first call.
+  size_t statsId(const ItemEntry& item) const {
+    return item.stats.get(name_, item.name);
+  }
+
+  /// Check if an item's plugin exists without constructing it.
+  static bool constructed(const ItemEntry& item) {
+    return item.ready.load(std::memory_order_acquire);
+  }
+
+  /// Add an item with a plugin or a factory, see addPlugin and addFactory.
+  Status addItem(const std::string& item_name,
+                 const PluginRef& plugin_item,
+                 PluginFactory factory,
+                 bool internal);
+
+  /// Remove an item, optionally leaving tearDown to a still-running setUp.
+  void remove(const std::string& item_name, bool tear_down);
+
+  /// Items constructed after the registry's setUp are set up on first use.
+  std::atomic<bool> set_up_{false};
+
+  /**
+   * @brief Record that a broadcast name's route may have changed.
+   *
+   * Each name is kept once, stamped with the broadcast generation of its
+   * latest change, so the log is bounded by the names ever broadcast.
+   */
+  void routeChanged(const std::string& name);
+
+  /// Discard the memoized routes, see getRoutesCache.
+  void invalidateRoutes() {
+    routes_version_.fetch_add(1, std::memory_order_acq_rel);
+  }
+
+  /// Compute the route table, see getRoutes.
+  RegistryRoutes computeRoutes() const;
+
+  /// The most recent route table, current if its version matches.
+  mutable std::shared_ptr<const RoutesCache> routes_cache_;
+
+  /// Bumped by every route change.
+  std::atomic<size_t> routes_version_{0};
+
+  /// Broadcast names by the generation they last changed.
+  std::map<size_t, std::string> route_log_;
+
+  /// Each logged name's generation, the key into route_log_.
+  std::map<std::string, size_t> route_generations_;
+
+  /// The broadcast generation when the registry was added to the factory.
+  size_t broadcast_added_{0};
+
+  /// Durations recorded by setUp, protected by mutex_.
+  std::map<std::string, std::chrono::microseconds> setup_durations_;
+
+  /// Invalidate every PluginCallHandle resolved against this registry.
+  void invalidate() {
+    generation_.fetch_add(1, std::memory_order_acq_rel);
+  }
+
+  /// See RegistryInterface::generation.
+  std::atomic<size_t> generation_{0};
+
+  /**
+   * @brief Serializes changes to the item tables and the index.
+   *
+   * Recursive, a Batch may be held around calls that open their own.
+   */
+  mutable RecursiveMutex mutex_;
+
+  /// Number of Batch scopes held, the outermost invalidates handles.
+  size_t batch_depth_{0};
+
+  /// An item was removed in the current batch, see invalidate.
+  bool stale_{false};
+
+ public:
+  /**
+   * @brief Group changes to the registry's items.
+   *
+   * A batch holds mutex_ across several changes. Each change is published
+   * as it is made, see index_, but handles are invalidated once, when the
+   * outermost batch ends.
+   */
+  class Batch : private boost::noncopyable {
+   public:
+    explicit Batch(RegistryInterface& registry);
+    ~Batch();
+
+   private:
+    RegistryInterface& registry_;
+    std::lock_guard<RecursiveMutex> lock_;
+
+   private:
+    friend class RegistryInterface;
+  };
+
  private:
   friend class RegistryFactory;
 };
@@ -374,20 +784,19 @@ class RegistryInterface : private boost::noncopyable {
  */
 template <class PluginType>
 class RegistryType : public RegistryInterface {
- protected:
+ public:
   using PluginTypeRef = std::shared_ptr<PluginType>;
 
- public:
   RegistryType(const std::string& name, bool auto_setup = false)
-      : RegistryInterface(name, auto_setup),
-        add_(&PluginType::addExternal),
-        remove_(&PluginType::removeExternal) {}
+      : RegistryInterface(name, auto_setup) {
+    plugin_type_ = &typeid(PluginType);
+  }
   virtual ~RegistryType() {}
 
   Status add(const std::string& plugin_name,
              const PluginRef& plugin_item,
              bool internal = false) override {
-    if (nullptr == std::dynamic_pointer_cast<PluginType>(plugin_item)) {
+    if (plugin_item == nullptr || !accepts(*plugin_item)) {
       throw std::runtime_error("Cannot add foreign plugin type: " +
                                plugin_name);
     }
@@ -404,32 +813,186 @@ class RegistryType : public RegistryInterface {
    * @return A std::shared_ptr of type RegistryType.
    */
   PluginRef plugin(const std::string& plugin_name) const override {
-    if (items_.count(plugin_name) == 0) {
+    EpochDomain::ReadSection section;
+    auto item = findItem(plugin_name);
+    if (item == nullptr) {
       return nullptr;
     }
-    return items_.at(plugin_name);
+    return instance(*item);
+  }
+
+  /**
+   * @brief A typed accessor for a registry plugin.
+   *
+   * Every item's type is checked once when it is added, so this is a static
+   * cast rather than a dynamic_pointer_cast per access.
+   *
+   * @param item_name An identifier for this registry plugin.
+   * @return The plugin, or nullptr if there is no local item_name.
+   */
+  PluginTypeRef typedPlugin(const std::string& plugin_name) const {
+    return std::static_pointer_cast<PluginType>(
+        RegistryType::plugin(plugin_name));
   }
 
   /// Trampoline function for calling the PluginType's addExternal.
   Status addExternalPlugin(const std::string& name,
                            const PluginResponse& info) const override {
-    return add_(name, info);
+    return PluginType::addExternal(name, info);
   }
 
   /// Trampoline function for calling the PluginType's removeExternal.
   void removeExternalPlugin(const std::string& name) const override {
-    remove_(name);
+    PluginType::removeExternal(name);
   }
 
- private:
-  AddExternalCallback add_;
-  RemoveExternalCallback remove_;
-
+ protected:
+  bool accepts(const Plugin& plugin) const override {
+    return dynamic_cast<const PluginType*>(&plugin) != nullptr;
+  }
 };
 
 /// Helper definitions for a shared pointer to the basic Registry type.
 using RegistryInterfaceRef = std::shared_ptr<RegistryInterface>;
 
+/// The outcome of an asynchronous or batched registry call.
+struct PluginCallResult {
+  Status status;
+  PluginResponse response;
+};
+
+/**
+ * @brief A connection to an extension, used to call its broadcast items.
+ *
+ * Registries only record which extension (RouteUUID) broadcast an external
+ * item. Calls to that item are forwarded to the transport set for the
+ * extension with RegistryFactory::setTransport.
+ */
+class ExtensionTransport : private boost::noncopyable {
+ public:
+  virtual ~ExtensionTransport() {}
+
+  /// Call an item the extension broadcast, may be called concurrently.
+  virtual Status call(const std::string& registry_name,
+                      const std::string& item_name,
+                      const PluginRequest& request,
+                      PluginResponse& response) = 0;
+
+  /**
+   * @brief Call an item once per request, appending a result for each.
+   *
+   * Transports should coalesce the requests into as few messages as they
+   * can, the default makes one call per request.
+   */
+  virtual void callBatch(const std::string& registry_name,
+                         const std::string& item_name,
+                         const std::vector<PluginRequest>& requests,
+                         std::vector<PluginCallResult>& results) {
+    for (const auto& request : requests) {
+      results.emplace_back();
+      results.back().status =
+          call(registry_name, item_name, request, results.back().response);
+    }
+  }
+};
+
+using ExtensionTransportRef = std::shared_ptr<ExtensionTransport>;
+
+/**
+ * @brief An immutable version of the RegistryFactory's registry table.
+ *
+ * Registries are rarely created after initialization but looked up on every
+ * call. The factory publishes a new snapshot for each change and readers use
+ * whichever snapshot they loaded, see EpochDomain.
+ */
+struct RegistrySnapshot {
+  /// Registry name to registry, ordered for introspection.
+  std::map<std::string, RegistryInterfaceRef> registries;
+
+  /// Name lookup for the call paths, points into registries.
+  FlatIndex<RegistryInterface*> index;
+};
+
+/**
+ * @brief A resolved (registry, item) pair for repeated registry calls.
+ *
+ * Schedulers and loggers call the same item many times. A handle performs
+ * the registry and item lookups once, see RegistryFactory::resolve, and
+ * later calls only compare the registry's generation counter. When the
+ * registry changed the handle transparently resolves again.
+ */
+class PluginCallHandle {
+ public:
+  PluginCallHandle() = default;
+
+  /// True if the handle resolved to a local plugin that is still current.
+  bool valid() const {
+    return registry_ != nullptr && plugin_ != nullptr &&
+           generation_ == registry_->generation();
+  }
+
+  const std::string& registryName() const {
+    return registry_name_;
+  }
+
+  const std::string& itemName() const {
+    return item_name_;
+  }
+
+ private:
+  /// The requested names, kept to resolve again after invalidation.
+  std::string registry_name_;
+  std::string item_name_;
+
+  /// Registries are never removed from the factory, a raw pointer is safe.
+  RegistryInterface* registry_{nullptr};
+
+  /// Holding a reference keeps a concurrently removed plugin alive.
+  PluginRef plugin_{nullptr};
+
+  /// The registry generation observed when plugin_ was resolved.
+  size_t generation_{0};
+
+  /// The resolved item's PluginStats identifier.
+  size_t stats_{0};
+
+ private:
+  friend class RegistryFactory;
+};
+
+/**
+ * @brief A pending RegistryFactory::callAsync.
+ *
+ * Like a TaskGroup task, the call is queued to the Executor but started at
+ * most once: if wait finds it still queued it is started on the waiting
+ * thread. Waiting from an Executor worker therefore cannot deadlock the pool.
+ */
+class PluginCallFuture {
+ public:
+  PluginCallFuture() = default;
+
+  /// False for a default constructed future or once get has returned.
+  bool valid() const {
+    return state_ != nullptr;
+  }
+
+  /// True if the call has completed, get will not block.
+  bool ready() const;
+
+  /// Wait for the call to complete, starting it here if no worker has.
+  void wait();
+
+  /// Wait for and take the result, the future is no longer valid.
+  PluginCallResult get();
+
+ private:
+  struct State;
+  std::shared_ptr<State> state_;
+
+ private:
+  friend class RegistryFactory;
+};
+
 /**
  * @brief A workflow manager for opening a module path and appending to the
  * core registry.
@@ -446,14 +1009,37 @@ using RegistryInterfaceRef = std::shared_ptr<RegistryInterface>;
  */
 class RegistryModuleLoader : private boost::noncopyable {
  public:
-  /// Unlock the registry, open, construct, and allow the module to declare.
+  /**
+   * @brief Assign the module a RouteUUID and open it.
+   *
+   * Registrations made by the module's static initializers are staged, on
+   * this thread, instead of added to the registries.
+   */
   explicit RegistryModuleLoader(const std::string& path);
 
-  /// Clear module information, 'lock' the registry.
+  /// Clear module information unless the module was committed.
   ~RegistryModuleLoader();
 
-  /// Keep the symbol resolution/calling out of construction.
-  void init();
+  /// Let the module declare itself, then commit its staged registrations.
+  Status init();
+
+  /**
+   * @brief Open and declare every module in a directory concurrently.
+   *
+   * Each module stages into its own area on an Executor worker. The accepted
+   * modules are then committed in path order, so a duplicate item name is
+   * owned by the same module on every start.
+   *
+   * @return The number of modules committed.
+   */
+  static size_t loadDirectory(const std::string& directory);
+
+ private:
+  /// Call the module's initModule, staging what it registers.
+  Status declare();
+
+  /// Add every staged registration, or none if any would fail.
+  Status commit();
 
  private:
   /// Keep the handle for symbol resolution/calling.
@@ -462,6 +1048,11 @@ class RegistryModuleLoader : private boost::noncopyable {
   /// Keep the path for debugging/logging.
   std::string path_;
 
+  /// The module's identity and registrations until it is committed.
+  std::unique_ptr<ModuleStage> stage_;
+
+  bool committed_{false};
+
  private:
   FRIEND_TEST(RegistryTests, test_registry_modules);
 };
@@ -498,6 +1089,27 @@ class RegistryFactory : private boost::noncopyable {
                      const PluginRequest& request,
                      PluginResponse& response);
 
+  /**
+   * @brief Call several items of one registry concurrently.
+   *
+   * This is used for multiplexed "a,b,c" item names, usually several
+   * loggers. Every item is called regardless of the other items' statuses,
+   * each on the shared Executor with the calling thread taking a share.
+   * Latency is bounded by the slowest item rather than the sum.
+   *
+   * @param registry_name The registry containing each item.
+   * @param item_names The items to call with the same request.
+   * @param request The PluginRequest object handled by each item.
+   * @param response Each item's response appended in item_names order.
+   * @param statuses Output status for each item, in item_names order.
+   * @return Success if every item succeeded, otherwise the failed items.
+   */
+  static Status callMultiplexed(const std::string& registry_name,
+                                const std::vector<std::string>& item_names,
+                                const PluginRequest& request,
+                                PluginResponse& response,
+                                std::vector<Status>& statuses);
+
   /// A helper call that does not return a response (only status).
   static Status call(const std::string& registry_name,
                      const std::string& item_name,
@@ -512,18 +1124,157 @@ class RegistryFactory : private boost::noncopyable {
   static Status call(const std::string& registry_name,
                      const PluginRequest& request);
 
+  /**
+   * @brief Call a registry item using a flat PluginRecord request.
+   *
+   * Local plugins receive the record through Plugin::callRecord. Other items,
+   * such as external routes, receive the adapted PluginRequest.
+   */
+  static Status callRecord(const std::string& registry_name,
+                           const std::string& item_name,
+                           const PluginRecord& request,
+                           PluginResponse& response);
+
+  /**
+   * @brief Resolve a registry item once for repeated calls.
+   *
+   * The returned handle may be stored by the caller and used with the
+   * handle-based call. If the item is not a local plugin (e.g., an external
+   * route or a multiplexed list) the handle falls back to the named call.
+   */
+  static PluginCallHandle resolve(const std::string& registry_name,
+                                  const std::string& item_name);
+
+  /// Call a resolved registry item, skipping both name lookups when current.
+  static Status call(PluginCallHandle& handle,
+                     const PluginRequest& request,
+                     PluginResponse& response);
+
+  /**
+   * @brief Call a registry item whose expected implementation is known.
+   *
+   * If the item is exactly a FinalPlugin, which must be a final class, the
+   * call is made through the concrete type and can be inlined instead of
+   * dispatched through the vtable (and, under -fsanitize=cfi, checked).
+   * Any other item is called normally.
+   */
+  template <class FinalPlugin>
+  static Status callFinal(const std::string& registry_name,
+                          const std::string& item_name,
+                          const PluginRequest& request,
+                          PluginResponse& response);
+
+  /**
+   * @brief Call a registry item on the shared Executor.
+   *
+   * The request is copied. Local items are started with Plugin::callAsync,
+   * so an AsyncPlugin only holds a worker until its I/O is started. External
+   * routes and multiplexed items use the named call on a worker.
+   */
+  static PluginCallFuture callAsync(const std::string& registry_name,
+                                    const std::string& item_name,
+                                    const PluginRequest& request);
+
+  /**
+   * @brief Call a registry item once per request.
+   *
+   * Requests to an external item are handed to its extension's transport
+   * together, see ExtensionTransport::callBatch, so many small calls cost a
+   * few round trips. Local items are called in order.
+   *
+   * @return A result for each request, in request order.
+   */
+  static std::vector<PluginCallResult> callBatch(
+      const std::string& registry_name,
+      const std::string& item_name,
+      const std::vector<PluginRequest>& requests);
+
+  /// Call a registry item on the shared Executor, invoking done once.
+  static void callAsync(const std::string& registry_name,
+                        const std::string& item_name,
+                        const PluginRequest& request,
+                        PluginCompletion done);
+
   /// A helper call optimized for table data generation.
   static Status callTable(const std::string& table_name,
                           QueryContext& context,
                           PluginResponse& response);
 
-  /// Run `setUp` on every registry that is not marked 'lazy'.
+  /**
+   * @brief Stream a table's rows to a consumer in bounded batches.
+   *
+   * The table generates on the shared Executor while the calling thread runs
+   * the consumer, so the first rows are consumed before generation ends. At
+   * most a couple of batches are buffered: the generator blocks when the
+   * consumer falls behind, so peak memory depends on batch_size rather than
+   * the table's size. If no worker picks up generation promptly it runs on
+   * the calling thread, calling the consumer inline.
+   *
+   * @param table_name The "table" registry item.
+   * @param context The query context passed to the table.
+   * @param batch_size Maximum rows handed to each consumer call.
+   * @param consumer Receives each batch; a failed status stops generation.
+   * @return The first consumer failure, or the table's generation status.
+   */
+  static Status callTable(const std::string& table_name,
+                          QueryContext& context,
+                          size_t batch_size,
+                          std::function<Status(QueryData& batch)> consumer);
+
+  /**
+   * @brief Stream a table's rows to a consumer as columnar batches.
+   *
+   * Each bounded batch is converted to a RowBatch. Batches share one column
+   * dictionary, which grows as rows introduce new columns, so column names
+   * are stored once per call rather than once per row.
+   */
+  static Status callTable(const std::string& table_name,
+                          QueryContext& context,
+                          size_t batch_size,
+                          std::function<Status(RowBatch& batch)> consumer);
+
+  /**
+   * @brief Run `setUp` on every registry that is not marked 'lazy'.
+   *
+   * Registries are set up in waves: a registry starts once every registry it
+   * depends on (see addSetUpDependency) has finished. All items of a wave
+   * are set up concurrently on the shared Executor, the calling thread takes
+   * any item no worker has started and then waits, applying the optional
+   * per-item setUpTimeout. It may therefore be called from a worker.
+   */
   static void setUp();
 
+  /// Declare that registry_name must be set up after depends_on.
+  void addSetUpDependency(const std::string& registry_name,
+                          const std::string& depends_on);
+
+  /// Fail and remove items whose setUp exceeds timeout, 0 waits forever.
+  void setUpTimeout(std::chrono::milliseconds timeout) {
+    setup_timeout_ = timeout;
+  }
+
+  /// Per-registry, per-item durations of the most recent setUp.
+  std::map<std::string, std::map<std::string, std::chrono::microseconds>>
+  getSetUpDurations() const;
+
  public:
-  /// Direct access to a registry instance.
+  /**
+   * @brief Direct access to a registry instance.
+   *
+   * Throws std::runtime_error for an unknown registry, kept for legacy
+   * callers. Lookups that may miss should use tryRegistry.
+   */
   RegistryInterfaceRef registry(const std::string& registry_name) const;
 
+  /**
+   * @brief Non-throwing registry lookup.
+   *
+   * Registries are never removed, so the pointer stays valid. A miss costs
+   * neither an exception nor, for short names, an allocation.
+   */
+  Expected<RegistryInterface*> tryRegistry(
+      const std::string& registry_name) const;
+
   void add(const std::string& name, RegistryInterfaceRef reg);
 
   /// Direct access to all registries.
@@ -533,20 +1284,80 @@ class RegistryFactory : private boost::noncopyable {
   std::map<std::string, PluginRef> plugins(
       const std::string& registry_name) const;
 
-  /// Direct access to a plugin instance.
+  /// Direct access to a plugin instance, throws for an unknown registry.
   PluginRef plugin(const std::string& registry_name,
                    const std::string& item_name) const;
 
+  /// Non-throwing plugin lookup, fails for an unknown registry or item.
+  Expected<PluginRef> tryPlugin(const std::string& registry_name,
+                                const std::string& item_name) const;
+
+  /**
+   * @brief Direct access to a plugin instance as the registry's plugin type.
+   *
+   * @return nullptr if the registry is unknown, its plugin type is not
+   * PluginType, or there is no local item_name.
+   */
+  template <class PluginType>
+  std::shared_ptr<PluginType> typedPlugin(const std::string& registry_name,
+                                          const std::string& item_name) const {
+    auto registry = find(registry_name);
+    if (registry == nullptr || registry->pluginType() != typeid(PluginType)) {
+      return nullptr;
+    }
+    return static_cast<RegistryType<PluginType>*>(registry)->typedPlugin(
+        item_name);
+  }
+
   /// Serialize this core or extension's registry.
   RegistryBroadcast getBroadcast();
 
-  /// Add external registry items identified by a Route UUID.
+  /// The generation of the most recent route change in any registry.
+  static size_t broadcastGeneration() {
+    return broadcast_generation_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Serialize only the routes changed after a broadcast generation.
+   *
+   * A receiver holding the broadcast as of `since` applies the delta to
+   * reach the current broadcast, see applyBroadcastDelta. Registries added
+   * to the factory after `since` are sent in full.
+   *
+   * @param since The generation the receiver has, 0 for everything.
+   * @param generation Output, the generation the delta brings it to.
+   */
+  RegistryBroadcastDelta getBroadcastDelta(size_t since, size_t& generation);
+
+  /**
+   * @brief Add external registry items identified by a Route UUID.
+   *
+   * The whole broadcast is validated first, for a duplicate UUID and
+   * (unless duplicates are allowed) names that already exist. It is then
+   * applied to every registry under a single write lock. If any registry
+   * rejects its routes every registry is rolled back, so a broadcast is
+   * either fully added or not at all. Unknown registries are skipped.
+   */
   Status addBroadcast(const RouteUUID& uuid,
                       const RegistryBroadcast& broadcast);
 
   /// Given an extension UUID remove all external registry items.
   Status removeBroadcast(const RouteUUID& uuid);
 
+  /**
+   * @brief Set the transport used to call an extension's external items.
+   *
+   * The transport is dropped when the extension's broadcast is removed.
+   */
+  Status setTransport(const RouteUUID& uuid, ExtensionTransportRef transport);
+
+  /// Call an external item through its extension's transport.
+  Status callExternal(const RouteUUID& uuid,
+                      const std::string& registry_name,
+                      const std::string& item_name,
+                      const PluginRequest& request,
+                      PluginResponse& response) const;
+
   /// Adds an alias for an internal registry item. This registry will only
   /// broadcast the alias name.
   Status addAlias(const std::string& registry_name,
@@ -565,7 +1376,7 @@ class RegistryFactory : private boost::noncopyable {
   std::string getActive(const std::string& registry_nane) const;
 
   bool exists(const std::string& registry_name) const {
-    return (registries_.count(registry_name) > 0);
+    return find(registry_name) != nullptr;
   }
 
   /// Check if a registry item exists, optionally search only local registries.
@@ -584,7 +1395,8 @@ class RegistryFactory : private boost::noncopyable {
 
   /// Return the number of registries.
   size_t count() const {
-    return registries_.size();
+    EpochDomain::ReadSection section;
+    return registries_.load(std::memory_order_acquire)->registries.size();
   }
 
   /// Return the number of registry items for a given registry name.
@@ -600,7 +1412,13 @@ class RegistryFactory : private boost::noncopyable {
     return allow_duplicates_;
   }
 
-  /// Declare a module for initialization and subsequent registration attempts
+  /**
+   * @brief Declare the module being opened on this thread.
+   *
+   * The module's staged registrations may only be committed if the registry
+   * SDK version is at least min_sdk_version. Outside of a module load this
+   * does nothing.
+   */
   void declareModule(const std::string& name,
                      const std::string& version,
                      const std::string& min_sdk_version,
@@ -621,45 +1439,65 @@ class RegistryFactory : private boost::noncopyable {
   }
 
  public:
-  /// Access the current initializing module UUID.
+  /// The module whose registrations this thread is committing, or 0.
   RouteUUID getModule();
 
-  /// Check if the registry is allowing module registrations.
+  /// Check if this thread is committing a module's registrations.
   bool usingModule();
 
-  /// Initialize a module for lookup, resolution, and its registrations.
-  void initModule(const std::string& path);
+  /// Record a new module's path under a RouteUUID that is never reused.
+  RouteUUID initModule(const std::string& path);
 
-  /// Finish module registration.
-  void shutdownModule();
+  /// Forget a module that failed to open, declare, or commit.
+  void removeModule(const RouteUUID& uuid);
 
-  /// Check if the registries are locked.
-  bool locked() {
-    return locked_;
-  }
-
-  /// Set the registry locked status.
-  void locked(bool locked) {
-    locked_ = locked;
-  }
+  /**
+   * @brief Undo the registrations of a module whose commit failed part way.
+   *
+   * Items the module added are removed. The named registries are removed
+   * from the factory but never destroyed, callers may hold a raw pointer.
+   */
+  void rollbackModule(const RouteUUID& uuid,
+                      const std::set<std::string>& registries);
 
  protected:
   RegistryFactory()
       : allow_duplicates_(false),
-        locked_(false),
-        module_uuid_(0),
+        registries_(new RegistrySnapshot()),
         external_(false) {}
-  virtual ~RegistryFactory() {}
+  virtual ~RegistryFactory() {
+    delete registries_.load();
+  }
+
+  /**
+   * @brief Lock-free registry lookup for the call paths.
+   *
+   * Registries are never destroyed, so the returned pointer outlives the
+   * read section used to find it. Returns nullptr for an unknown registry.
+   */
+  RegistryInterface* find(const std::string& registry_name) const;
+
+  /// Set up the items of several registries concurrently, see setUp.
+  static void setUpRegistries(const std::vector<RegistryInterface*>& wave);
+
+  /// The transport set for an extension, or nullptr.
+  ExtensionTransportRef getTransport(const RouteUUID& uuid) const;
+
+  /// Start a queued callAsync, on a worker or a waiting thread.
+  static void startAsync(const std::shared_ptr<PluginCallFuture::State>& call);
 
  public:
   /// Track duplicate registry item support, used for testing.
   bool allow_duplicates_{false};
 
-  /// Track registry "locking", while locked a registry cannot add/create.
-  bool locked_{false};
-
-  /// The primary storage for constructed registries.
-  std::map<std::string, RegistryInterfaceRef> registries_;
+  /**
+   * @brief The primary storage for constructed registries.
+   *
+   * Readers load the current snapshot within an EpochDomain::ReadSection.
+   * Writers serialize on mutex_, publish a modified copy, and retire the
+   * previous snapshot.
+   */
+  std::atomic<const RegistrySnapshot*> registries_;
 
   /**
    * @brief The registry tracks the set of active extension routes.
@@ -671,6 +1509,9 @@ class RegistryFactory : private boost::noncopyable {
    */
   std::set<RouteUUID> extensions_;
 
+  /// Transports to the extensions_, see setTransport.
+  std::map<RouteUUID, ExtensionTransportRef> transports_;
+
   /**
    * @brief The registry tracks loaded extension module metadata/info.
    *
@@ -680,8 +1521,20 @@ class RegistryFactory : private boost::noncopyable {
    */
   std::map<RouteUUID, ModuleInfo> modules_;
 
-  /// During module initialization store the current-working module ID.
-  RouteUUID module_uuid_{0};
+  /// The last module RouteUUID assigned.
+  RouteUUID last_module_{0};
+
+  /// Protects modules_, and serializes module commits.
+  mutable Mutex modules_mutex_;
+
+  /// Registries removed by rollbackModule, kept alive for raw pointers.
+  std::vector<RegistryInterfaceRef> removed_registries_;
+
+  /// Registries that must finish setUp before a given registry starts.
+  std::map<std::string, std::set<std::string>> setup_dependencies_;
+
+  /// Per-item setUp timeout, 0 waits forever.
+  std::chrono::milliseconds setup_timeout_{0};
 
   /// Calling startExtension should declare the registry external.
   /// This will cause extension-internal events to forward to osquery core.
@@ -690,6 +1543,13 @@ class RegistryFactory : private boost::noncopyable {
   /// Protector for broadcast lookups and external registry mutations.
   mutable Mutex mutex_;
 
+ private:
+  /// Stamps route changes, see RegistryInterface::routeChanged.
+  static std::atomic<size_t> broadcast_generation_;
+
+ private:
+  friend class PluginCallFuture;
+  friend class RegistryInterface;
 };
 
 /**
@@ -704,9 +1564,107 @@ class RegistryFactory : private boost::noncopyable {
  */
 using Registry = RegistryFactory;
 
+template <class FinalPlugin>
+Status RegistryFactory::callFinal(const std::string& registry_name,
+                                  const std::string& item_name,
+                                  const PluginRequest& request,
+                                  PluginResponse& response) {
+  static_assert(std::is_final<FinalPlugin>::value,
+                "callFinal requires a final plugin class");
+  static_assert(std::is_base_of<Plugin, FinalPlugin>::value,
+                "callFinal requires a plugin class");
+
+  auto registry = get().find(registry_name);
+  EpochDomain::ReadSection section;
+  auto item = (registry == nullptr) ? nullptr : registry->findItem(item_name);
+  if (item == nullptr) {
+    return call(registry_name, item_name, request, response);
+  }
+
+  try {
+    const auto& plugin = registry->instance(*item);
+    PluginCallTimer timer(registry->statsId(*item));
+    auto offset = response.size();
+    auto status = (typeid(*plugin) != typeid(FinalPlugin))
+                      ? plugin->call(request, response)
+                      : static_cast<FinalPlugin&>(*plugin).call(request,
+                                                                 response);
+    timer.finish(status.ok(), request, response, offset);
+    return status;
+  } catch (const std::exception& e) {
+    return Status(1, e.what());
+  } catch (...) {
+    return Status(2, STATUS_LITERAL("Unknown exception"));
+  }
+}
+
+/**
+ * @brief A static registry registration, emitted by CREATE_REGISTRY.
+ *
+ * Registration records are plain aggregates of string literals and a factory
+ * function pointer, so they are constant-initialized: no constructor runs and
+ * nothing is allocated before main. On ELF platforms the macros place every
+ * record into a named linker section and registryAndPluginInit iterates the
+ * section as an array.
+ */
+struct RegistryRegistration {
+  using Factory = RegistryInterfaceRef (*)(const char* name, bool optional);
+
+  /// The registry name, or type identifier.
+  const char* type;
+
+  /// The registry name.
+  const char* name;
+
+  /// Autoload the registry.
+  bool optional;
+
+  Factory create;
+};
+
+/// A static plugin registration, emitted by REGISTER.
+struct PluginRegistration {
+  using Factory = PluginFactory;
+
+  /// The registry the plugin is added to.
+  const char* type;
+
+  /// The plugin name.
+  const char* name;
+
+  /// The plugin is internal and not broadcast.
+  bool internal;
+
+  Factory create;
+};
+
+/**
+ * @brief Add every registry in a registration table to the RegistryFactory.
+ *
+ * While a module is being opened or declared on the calling thread, the
+ * table is staged with the module instead, see RegistryModuleLoader.
+ */
+void registerRegistries(const RegistryRegistration* begin,
+                        const RegistryRegistration* end);
+
+/**
+ * @brief Add every plugin in a registration table to its registry, or stage it.
+ *
+ * A record naming an unknown registry or a duplicate item does not stop the
+ * rest of the table, the first failure is returned.
+ */
+Status registerPlugins(const PluginRegistration* begin,
+                       const PluginRegistration* end);
+
 class AutoRegisterInterface;
 using AutoRegisterSet = std::vector<std::unique_ptr<AutoRegisterInterface>>;
 
+/**
+ * @brief Dynamic registration, used where linker sections are unavailable.
+ *
+ * Each registration is a heap-allocated object queued during static
+ * initialization, see OSQUERY_STATIC_REGISTRATION.
+ */
 class AutoRegisterInterface {
  public:
   /// The registry name, or type identifier.
@@ -722,8 +1680,8 @@ class AutoRegisterInterface {
       : type_(_type), name_(_name), optional_(optional) {}
   virtual ~AutoRegisterInterface() {}
 
-  /// A call-in for the iterator.
-  virtual void run() = 0;
+  /// A call-in for the iterator, the status of the registration.
+  virtual Status run() = 0;
 
  public:
   /// Access all registries.
@@ -732,10 +1690,8 @@ class AutoRegisterInterface {
     return registries_;
   }
 
-  /// Insert a new registry.
-  static void autoloadRegistry(std::unique_ptr<AutoRegisterInterface> ar_) {
-    registries().push_back(std::move(ar_));
-  }
+  /// Insert a new registry, or stage it if a module is being opened.
+  static void autoloadRegistry(std::unique_ptr<AutoRegisterInterface> ar_);
 
   /// Access all plugins.
   static AutoRegisterSet& plugins() {
@@ -743,23 +1699,32 @@ class AutoRegisterInterface {
     return plugins_;
   }
 
-  /// Insert a new plugin.
-  static void autoloadPlugin(std::unique_ptr<AutoRegisterInterface> ar_) {
-    plugins().push_back(std::move(ar_));
-  }
+  /// Insert a new plugin, or stage it if a module is being opened.
+  static void autoloadPlugin(std::unique_ptr<AutoRegisterInterface> ar_);
 };
 
 namespace registries {
 
+template <class R>
+RegistryInterfaceRef createRegistry(const char* name, bool optional) {
+  return std::make_shared<RegistryType<R>>(name, optional);
+}
+
+template <class P>
+PluginRef createPlugin() {
+  return std::make_shared<P>();
+}
+
 template <class R>
 class AR : public AutoRegisterInterface {
  public:
   AR(const char* t, const char* n, bool optional)
       : AutoRegisterInterface(t, n, optional) {}
 
-  void run() override {
+  Status run() override {
     RegistryFactory::get().add(
         type_, std::make_shared<RegistryType<R>>(name_, optional_));
+    return Status(0, "OK");
   }
 };
 
@@ -769,9 +1734,12 @@ class AP : public AutoRegisterInterface {
   AP(const char* t, const char* n, bool optional)
       : AutoRegisterInterface(t, n, optional) {}
 
-  void run() override {
-    auto registry = RegistryFactory::get().registry(type_);
-    registry->add(name_, std::make_shared<P>(), optional_);
+  Status run() override {
+    auto registry = RegistryFactory::get().tryRegistry(type_);
+    if (!registry) {
+      return registry.getStatus();
+    }
+    return (*registry)->addFactory(name_, &createPlugin<P>, optional_);
   }
 };
 
@@ -790,6 +1758,41 @@ struct PI {
 };
 }
 
+/*
+ * ELF linkers define __start_<section> and __stop_<section> for any section
+ * whose name is a C identifier. Records are explicitly aligned so the
+ * compiler does not over-align them, keeping the section a dense array.
+ */
+#if defined(__ELF__) && !defined(OSQUERY_DYNAMIC_REGISTRATION)
+#define OSQUERY_STATIC_REGISTRATION 1
+
+#define OSQUERY_REGISTRATION_RECORD(s, T)                                      \
+  __attribute__((section(#s), used, aligned(alignof(T)))) const T
+
+#define CREATE_REGISTRY(t, n)                                                  \
+  namespace registries {                                                       \
+  OSQUERY_REGISTRATION_RECORD(osquery_registries, RegistryRegistration)        \
+  k##t = {n, n, false, &createRegistry<t>};                                    \
+  }
+
+#define CREATE_LAZY_REGISTRY(t, n)                                             \
+  namespace registries {                                                       \
+  OSQUERY_REGISTRATION_RECORD(osquery_registries, RegistryRegistration)        \
+  k##t = {n, n, true, &createRegistry<t>};                                     \
+  }
+
+#define REGISTER(t, r, n)                                                      \
+  namespace registries {                                                       \
+  OSQUERY_REGISTRATION_RECORD(osquery_plugins, PluginRegistration)             \
+  k##t = {r, n, false, &createPlugin<t>};                                      \
+  }
+
+#define REGISTER_INTERNAL(t, r, n)                                             \
+  namespace registries {                                                       \
+  OSQUERY_REGISTRATION_RECORD(osquery_plugins, PluginRegistration)             \
+  k##t = {r, n, true, &createPlugin<t>};                                       \
+  }
+#else
 #define CREATE_REGISTRY(t, n)                                                  \
   namespace registries {                                                       \
   const RI<t> k##t(n, n, false);                                               \
@@ -809,6 +1812,53 @@ struct PI {
   namespace registries {                                                       \
   const PI<t> k##t(r, n, true);                                                \
   }
+#endif
 
-void registryAndPluginInit();
+/// Register the linked registries and plugins, the first failure is returned.
+Status registryAndPluginInit();
+}
+
+#ifdef OSQUERY_STATIC_REGISTRATION
+/**
+ * Linker-defined bounds of the registration sections, null if a section is
+ * empty. Hidden, so a module sees its own sections and never the core's.
+ */
+extern "C" {
+extern const osquery::RegistryRegistration __start_osquery_registries[]
+    __attribute__((weak, visibility("hidden")));
+extern const osquery::RegistryRegistration __stop_osquery_registries[]
+    __attribute__((weak, visibility("hidden")));
+extern const osquery::PluginRegistration __start_osquery_plugins[]
+    __attribute__((weak, visibility("hidden")));
+extern const osquery::PluginRegistration __stop_osquery_plugins[]
+    __attribute__((weak, visibility("hidden")));
 }
+
+#define OSQUERY_MODULE_REGISTRATIONS()                                         \
+  osquery::registerRegistries(__start_osquery_registries,                      \
+                              __stop_osquery_registries);                      \
+  osquery::registerPlugins(__start_osquery_plugins, __stop_osquery_plugins)
+#else
+/// Dynamic registrations were staged by the module's static initializers.
+#define OSQUERY_MODULE_REGISTRATIONS()
+#endif
+
+#ifdef OSQUERY_SDK_VERSION
+#define OSQUERY_REGISTRY_SDK_VERSION STR(OSQUERY_SDK_VERSION)
+#else
+#define OSQUERY_REGISTRY_SDK_VERSION "0.0.0"
+#endif
+
+/**
+ * @brief Define a module's initModule, called by RegistryModuleLoader.
+ *
+ * The module declares itself and stages its registrations, which are added
+ * to the registries only if the declaration is accepted.
+ */
+#define CREATE_MODULE(name, version, min_sdk_version)                          \
+  extern "C" EXPORT_FUNCTION void initModule(void);                            \
+  void initModule(void) {                                                      \
+    osquery::RegistryFactory::get().declareModule(                             \
+        name, version, min_sdk_version, OSQUERY_REGISTRY_SDK_VERSION);         \
+    OSQUERY_MODULE_REGISTRATIONS();                                            \
+  }
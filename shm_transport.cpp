@@ -0,0 +1,749 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <new>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <shm_transport.h>
+
+namespace osquery {
+
+namespace {
+
+/// Writes a frame into a buffer sized by the matching *Size function.
+class FrameWriter {
+ public:
+  explicit FrameWriter(char* out) : out_(out) {}
+
+  void u32(uint32_t value) {
+    std::memcpy(out_, &value, sizeof(value));
+    out_ += sizeof(value);
+  }
+
+  void u64(uint64_t value) {
+    std::memcpy(out_, &value, sizeof(value));
+    out_ += sizeof(value);
+  }
+
+  void bytes(const std::string& value) {
+    u32(static_cast<uint32_t>(value.size()));
+    std::memcpy(out_, value.data(), value.size());
+    out_ += value.size();
+  }
+
+  void message(const Status& status) {
+    u32(static_cast<uint32_t>(status.getMessageSize()));
+    out_ += status.copyMessage(out_);
+  }
+
+  void fields(const PluginRequest& fields) {
+    u32(static_cast<uint32_t>(fields.size()));
+    for (const auto& field : fields) {
+      bytes(field.first);
+      bytes(field.second);
+    }
+  }
+
+ private:
+  char* out_;
+};
+
+/// A bounds-checked cursor over a frame from another process.
+class FrameReader {
+ public:
+  explicit FrameReader(boost::string_ref frame) : frame_(frame) {}
+
+  bool u32(uint32_t& value) {
+    return fixed(&value, sizeof(value));
+  }
+
+  bool u64(uint64_t& value) {
+    return fixed(&value, sizeof(value));
+  }
+
+  bool bytes(std::string& value) {
+    uint32_t size = 0;
+    if (!u32(size) || size > frame_.size() - position_) {
+      return false;
+    }
+    value.assign(frame_.data() + position_, size);
+    position_ += size;
+    return true;
+  }
+
+  bool fields(PluginRequest& fields) {
+    uint32_t count = 0;
+    if (!u32(count)) {
+      return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      std::string key;
+      std::string value;
+      if (!bytes(key) || !bytes(value)) {
+        return false;
+      }
+      fields[std::move(key)] = std::move(value);
+    }
+    return true;
+  }
+
+  bool done() const {
+    return position_ == frame_.size();
+  }
+
+  size_t remaining() const {
+    return frame_.size() - position_;
+  }
+
+ private:
+  bool fixed(void* value, size_t size) {
+    if (size > frame_.size() - position_) {
+      return false;
+    }
+    std::memcpy(value, frame_.data() + position_, size);
+    position_ += size;
+    return true;
+  }
+
+ private:
+  boost::string_ref frame_;
+  size_t position_{0};
+};
+
+size_t fieldsSize(const PluginRequest& fields) {
+  size_t size = sizeof(uint32_t);
+  for (const auto& field : fields) {
+    size += 2 * sizeof(uint32_t) + field.first.size() + field.second.size();
+  }
+  return size;
+}
+}
+
+size_t extensionRequestSize(const std::string& registry_name,
+                            const std::string& item_name,
+                            const PluginRequest* requests,
+                            size_t count) {
+  size_t size = sizeof(uint64_t) + 3 * sizeof(uint32_t) +
+                registry_name.size() + item_name.size();
+  for (size_t i = 0; i < count; i++) {
+    size += fieldsSize(requests[i]);
+  }
+  return size;
+}
+
+void encodeExtensionRequest(uint64_t id,
+                            const std::string& registry_name,
+                            const std::string& item_name,
+                            const PluginRequest* requests,
+                            size_t count,
+                            char* out) {
+  FrameWriter writer(out);
+  writer.u64(id);
+  writer.bytes(registry_name);
+  writer.bytes(item_name);
+  writer.u32(static_cast<uint32_t>(count));
+  for (size_t i = 0; i < count; i++) {
+    writer.fields(requests[i]);
+  }
+}
+
+Status decodeExtensionRequest(boost::string_ref frame,
+                              uint64_t& id,
+                              std::string& registry_name,
+                              std::string& item_name,
+                              std::vector<PluginRequest>& requests) {
+  FrameReader reader(frame);
+  uint32_t count = 0;
+  if (!reader.u64(id) || !reader.bytes(registry_name) ||
+      !reader.bytes(item_name) || !reader.u32(count)) {
+    return Status(1, STATUS_LITERAL("Malformed extension request"));
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    requests.emplace_back();
+    if (!reader.fields(requests.back())) {
+      return Status(1, STATUS_LITERAL("Malformed extension request"));
+    }
+  }
+  if (!reader.done()) {
+    return Status(1, STATUS_LITERAL("Malformed extension request"));
+  }
+  return Status(0, "OK");
+}
+
+static size_t resultSize(const PluginCallResult& result) {
+  size_t size = 3 * sizeof(uint32_t) + result.status.getMessageSize();
+  for (const auto& row : result.response) {
+    size += fieldsSize(row);
+  }
+  return size;
+}
+
+size_t extensionResponseSize(const PluginCallResult* results, size_t count) {
+  size_t size = sizeof(uint64_t) + sizeof(uint32_t);
+  for (size_t i = 0; i < count; i++) {
+    size += resultSize(results[i]);
+  }
+  return size;
+}
+
+void encodeExtensionResponse(uint64_t id,
+                             const PluginCallResult* results,
+                             size_t count,
+                             char* out) {
+  FrameWriter writer(out);
+  writer.u64(id);
+  writer.u32(static_cast<uint32_t>(count));
+  for (size_t i = 0; i < count; i++) {
+    writer.u32(static_cast<uint32_t>(results[i].status.getCode()));
+    writer.message(results[i].status);
+    writer.u32(static_cast<uint32_t>(results[i].response.size()));
+    for (const auto& row : results[i].response) {
+      writer.fields(row);
+    }
+  }
+}
+
+Status decodeExtensionResponse(boost::string_ref frame,
+                               uint64_t& id,
+                               std::vector<PluginCallResult>& results) {
+  FrameReader reader(frame);
+  uint32_t count = 0;
+  if (!reader.u64(id) || !reader.u32(count)) {
+    return Status(1, STATUS_LITERAL("Malformed extension response"));
+  }
+
+  // Each result has at least a code, a message size, and a row count.
+  if (count > reader.remaining() / (3 * sizeof(uint32_t))) {
+    return Status(1, STATUS_LITERAL("Malformed extension response"));
+  }
+  std::vector<PluginCallResult> decoded(count);
+  for (auto& result : decoded) {
+    uint32_t code = 0;
+    std::string message;
+    uint32_t rows = 0;
+    if (!reader.u32(code) || !reader.bytes(message) || !reader.u32(rows)) {
+      return Status(1, STATUS_LITERAL("Malformed extension response"));
+    }
+    result.status = Status(static_cast<int>(code), message);
+    for (uint32_t i = 0; i < rows; i++) {
+      result.response.emplace_back();
+      if (!reader.fields(result.response.back())) {
+        return Status(1, STATUS_LITERAL("Malformed extension response"));
+      }
+    }
+  }
+  if (!reader.done()) {
+    return Status(1, STATUS_LITERAL("Malformed extension response"));
+  }
+
+  results.insert(results.end(),
+                 std::make_move_iterator(decoded.begin()),
+                 std::make_move_iterator(decoded.end()));
+  return Status(0, "OK");
+}
+
+#ifdef __linux__
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "Shared memory rings require address-free atomics");
+
+/// Each frame starts with its payload size.
+const size_t kFrameHeader = sizeof(uint64_t);
+
+/// A frame header telling the consumer to continue at the ring's start.
+const uint64_t kWrapMarker = std::numeric_limits<uint64_t>::max();
+
+/// The smallest ring, one page.
+const size_t kMinRingCapacity = 4096;
+
+/// Checks of the other side's position before sleeping on the eventfd.
+const size_t kRingSpins = 512;
+
+/// Spinning only helps if the other side is running on another CPU.
+static size_t getRingSpins() {
+  static const size_t spins =
+      (std::thread::hardware_concurrency() > 1) ? kRingSpins : 0;
+  return spins;
+}
+
+/// Frames are 8-byte aligned so every frame header is.
+static size_t frameSize(size_t payload) {
+  return kFrameHeader + ((payload + 7) & ~size_t{7});
+}
+
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+/// Positions count bytes ever produced and consumed, the producer and
+/// consumer write to separate cache lines.
+struct ShmRing::Header {
+  alignas(64) std::atomic<uint64_t> head{0};
+  alignas(64) std::atomic<uint64_t> tail{0};
+  alignas(64) std::atomic<uint32_t> reader_waiting{0};
+  alignas(64) std::atomic<uint32_t> writer_waiting{0};
+  std::atomic<uint32_t> closed{0};
+};
+
+ShmRing::~ShmRing() {
+  if (header_ != nullptr) {
+    header_->~Header();
+    ::munmap(header_, mapping_size_);
+  }
+  if (data_fd_ >= 0) {
+    ::close(data_fd_);
+  }
+  if (space_fd_ >= 0) {
+    ::close(space_fd_);
+  }
+}
+
+Status ShmRing::create(size_t capacity, std::unique_ptr<ShmRing>& ring) {
+  std::unique_ptr<ShmRing> created(new ShmRing());
+  created->capacity_ = kMinRingCapacity;
+  while (created->capacity_ < capacity) {
+    created->capacity_ <<= 1;
+  }
+
+  auto header_size = (sizeof(Header) + kMinRingCapacity - 1) &
+                     ~(kMinRingCapacity - 1);
+  created->mapping_size_ = header_size + created->capacity_;
+  auto mapping = ::mmap(nullptr,
+                        created->mapping_size_,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS,
+                        -1,
+                        0);
+  if (mapping == MAP_FAILED) {
+    return Status(1, STATUS_LITERAL("Cannot map ring: "), std::strerror(errno));
+  }
+  created->header_ = new (mapping) Header();
+  created->data_ = static_cast<char*>(mapping) + header_size;
+
+  created->data_fd_ = ::eventfd(0, EFD_NONBLOCK);
+  created->space_fd_ = ::eventfd(0, EFD_NONBLOCK);
+  if (created->data_fd_ < 0 || created->space_fd_ < 0) {
+    return Status(1,
+                  std::string("Cannot create ring eventfd: ") +
+                      std::strerror(errno));
+  }
+
+  ring = std::move(created);
+  return Status(0, "OK");
+}
+
+size_t ShmRing::maxFrame() const {
+  // A frame that does not fit before the end is preceded by a wrap, at most
+  // half of the ring guarantees the two fit in an empty ring.
+  return capacity_ / 2 - kFrameHeader;
+}
+
+bool ShmRing::wait(std::atomic<uint32_t>& waiting,
+                   int fd,
+                   std::chrono::milliseconds timeout,
+                   const std::function<bool()>& ready) const {
+  for (size_t spin = 0, spins = getRingSpins(); spin < spins; spin++) {
+    if (ready()) {
+      return true;
+    }
+    if (closed()) {
+      return false;
+    }
+    cpuRelax();
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (true) {
+    // Announce the sleep, then check again: the other side either sees the
+    // flag and writes the eventfd, or made progress before this check.
+    waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto is_ready = ready();
+    if (is_ready || closed()) {
+      waiting.store(0, std::memory_order_relaxed);
+      return is_ready;
+    }
+
+    int poll_timeout = -1;
+    if (timeout.count() >= 0) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      if (remaining.count() <= 0) {
+        waiting.store(0, std::memory_order_relaxed);
+        return false;
+      }
+      poll_timeout = static_cast<int>(remaining.count());
+    }
+
+    struct pollfd event = {fd, POLLIN, 0};
+    if (::poll(&event, 1, poll_timeout) > 0) {
+      uint64_t count = 0;
+      auto drained = ::read(fd, &count, sizeof(count));
+      static_cast<void>(drained);
+    }
+    waiting.store(0, std::memory_order_relaxed);
+  }
+}
+
+void ShmRing::wake(const std::atomic<uint32_t>& waiting, int fd) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting.load(std::memory_order_relaxed) != 0) {
+    uint64_t one = 1;
+    auto written = ::write(fd, &one, sizeof(one));
+    static_cast<void>(written);
+  }
+}
+
+char* ShmRing::reserve(size_t size, std::chrono::milliseconds timeout) {
+  if (size > maxFrame()) {
+    return nullptr;
+  }
+
+  // Only the producer writes head.
+  auto head = header_->head.load(std::memory_order_relaxed);
+  auto position = head & (capacity_ - 1);
+  auto total = frameSize(size);
+  auto skip = (capacity_ - position < total) ? capacity_ - position : 0;
+  auto needed = skip + total;
+  auto ready = [this, head, needed]() {
+    return capacity_ - (head - header_->tail.load(std::memory_order_acquire)) >=
+           needed;
+  };
+  if (!ready() &&
+      !wait(header_->writer_waiting, space_fd_, timeout, ready)) {
+    return nullptr;
+  }
+
+  if (skip != 0) {
+    // Published along with the frame by commit.
+    std::memcpy(data_ + position, &kWrapMarker, sizeof(kWrapMarker));
+    head += skip;
+    position = 0;
+  }
+  reserved_ = head;
+  reserved_size_ = size;
+  return data_ + position + kFrameHeader;
+}
+
+void ShmRing::commit() {
+  uint64_t size = reserved_size_;
+  std::memcpy(data_ + (reserved_ & (capacity_ - 1)), &size, sizeof(size));
+  header_->head.store(reserved_ + frameSize(reserved_size_),
+                      std::memory_order_release);
+  wake(header_->reader_waiting, data_fd_);
+}
+
+bool ShmRing::read(boost::string_ref& frame,
+                   std::chrono::milliseconds timeout) {
+  // Only the consumer writes tail.
+  auto tail = header_->tail.load(std::memory_order_relaxed);
+  auto ready = [this, tail]() {
+    return header_->head.load(std::memory_order_acquire) != tail;
+  };
+  if (!ready() && !wait(header_->reader_waiting, data_fd_, timeout, ready)) {
+    return false;
+  }
+
+  // The other process may be broken, a frame must be committed and must lie
+  // within the ring, otherwise stop trusting the ring.
+  auto head = header_->head.load(std::memory_order_acquire);
+  auto position = tail & (capacity_ - 1);
+  if ((tail % kFrameHeader) != 0 || head - tail > capacity_ ||
+      head - tail < kFrameHeader) {
+    close();
+    return false;
+  }
+
+  uint64_t size = 0;
+  std::memcpy(&size, data_ + position, sizeof(size));
+  if (size == kWrapMarker) {
+    if (head - tail < capacity_ - position + kFrameHeader) {
+      close();
+      return false;
+    }
+    tail += capacity_ - position;
+    position = 0;
+    std::memcpy(&size, data_, sizeof(size));
+  }
+
+  if (size > maxFrame() || frameSize(size) > head - tail ||
+      frameSize(size) > capacity_ - position) {
+    close();
+    return false;
+  }
+  frame = boost::string_ref(data_ + position + kFrameHeader, size);
+  read_end_ = tail + frameSize(size);
+  return true;
+}
+
+void ShmRing::release() {
+  header_->tail.store(read_end_, std::memory_order_release);
+  wake(header_->writer_waiting, space_fd_);
+}
+
+void ShmRing::close() {
+  header_->closed.store(1, std::memory_order_release);
+  uint64_t one = 1;
+  auto written = ::write(data_fd_, &one, sizeof(one));
+  written = ::write(space_fd_, &one, sizeof(one));
+  static_cast<void>(written);
+}
+
+bool ShmRing::closed() const {
+  return header_->closed.load(std::memory_order_acquire) != 0;
+}
+
+Status ShmChannel::create(size_t capacity,
+                          std::shared_ptr<ShmChannel>& channel) {
+  auto created = std::make_shared<ShmChannel>();
+  auto status = ShmRing::create(capacity, created->requests);
+  if (status.ok()) {
+    status = ShmRing::create(capacity, created->responses);
+  }
+  if (status.ok()) {
+    channel = std::move(created);
+  }
+  return status;
+}
+
+/// The extension waits for requests until osquery closes the channel.
+const std::chrono::milliseconds kWaitForever(-1);
+
+void serveShmChannel(ShmChannel& channel, const ShmCallHandler& handler) {
+  boost::string_ref frame;
+  while (channel.requests->read(frame, kWaitForever)) {
+    uint64_t id = 0;
+    std::string registry_name;
+    std::string item_name;
+    std::vector<PluginRequest> requests;
+    auto status =
+        decodeExtensionRequest(frame, id, registry_name, item_name, requests);
+    channel.requests->release();
+
+    std::vector<PluginCallResult> results(requests.size());
+    for (size_t i = 0; status.ok() && i < requests.size(); i++) {
+      try {
+        results[i].status = handler(
+            registry_name, item_name, requests[i], results[i].response);
+      } catch (const std::exception& e) {
+        results[i].status = Status(1, e.what());
+      }
+    }
+    if (!status.ok()) {
+      // The caller sees a result count mismatch and drops the channel.
+      results.assign(1, {status, {}});
+    }
+
+    // Split the results over as many frames as they need.
+    size_t first = 0;
+    while (first < results.size()) {
+      auto size = extensionResponseSize(nullptr, 0);
+      auto last = first;
+      while (last < results.size()) {
+        auto result_size = resultSize(results[last]);
+        if (size + result_size > channel.responses->maxFrame()) {
+          if (last > first) {
+            break;
+          }
+          results[last].response.clear();
+          results[last].status = Status(
+              1,
+              STATUS_LITERAL(
+                  "Extension response exceeds the channel frame size"));
+          result_size = resultSize(results[last]);
+        }
+        size += result_size;
+        last++;
+      }
+
+      auto out = channel.responses->reserve(size, kWaitForever);
+      if (out == nullptr) {
+        return;
+      }
+      encodeExtensionResponse(id, results.data() + first, last - first, out);
+      channel.responses->commit();
+      first = last;
+    }
+  }
+}
+
+/// Request frames written before waiting for the first response.
+const size_t kMaxFramesInFlight = 4;
+
+Status ShmExtensionTransport::call(const std::string& registry_name,
+                                   const std::string& item_name,
+                                   const PluginRequest& request,
+                                   PluginResponse& response) {
+  PluginCallResult result;
+  exchange(registry_name, item_name, &request, 1, &result);
+  response.insert(response.end(),
+                  std::make_move_iterator(result.response.begin()),
+                  std::make_move_iterator(result.response.end()));
+  return result.status;
+}
+
+void ShmExtensionTransport::callBatch(
+    const std::string& registry_name,
+    const std::string& item_name,
+    const std::vector<PluginRequest>& requests,
+    std::vector<PluginCallResult>& results) {
+  auto offset = results.size();
+  results.resize(offset + requests.size());
+  exchange(registry_name,
+           item_name,
+           requests.data(),
+           requests.size(),
+           results.data() + offset);
+}
+
+void ShmExtensionTransport::exchange(const std::string& registry_name,
+                                     const std::string& item_name,
+                                     const PluginRequest* requests,
+                                     size_t count,
+                                     PluginCallResult* results) {
+  struct Frame {
+    uint64_t id;
+    size_t begin;
+    size_t end;
+
+    /// Results may arrive over several response frames.
+    size_t received;
+  };
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& ring = *channel_->requests;
+  std::deque<Frame> in_flight;
+
+  // Fail every request from the oldest in-flight one, requests rejected as
+  // too large and results already received keep their own status.
+  auto fail = [&](size_t from, const Status& status) {
+    channel_->close();
+    for (size_t i = from; i < count; i++) {
+      if (results[i].status.ok()) {
+        results[i].status = status;
+      }
+    }
+  };
+
+  // Read a response frame for the oldest in-flight request frame.
+  auto receive = [&]() {
+    auto& sent = in_flight.front();
+    boost::string_ref frame;
+    if (!channel_->responses->read(frame, timeout_)) {
+      return Status(
+          1, STATUS_LITERAL("Extension call failed or timed out: "), item_name);
+    }
+
+    uint64_t id = 0;
+    std::vector<PluginCallResult> received;
+    Status status;
+    try {
+      status = decodeExtensionResponse(frame, id, received);
+    } catch (const std::exception& e) {
+      status = Status(
+          1, STATUS_LITERAL("Malformed extension response: "), e.what());
+    }
+    // A failed decode also fails the exchange, which closes the channel.
+    channel_->responses->release();
+    if (!status.ok()) {
+      return status;
+    }
+    auto remaining = sent.end - sent.begin - sent.received;
+    if (id != sent.id || received.empty() || received.size() > remaining) {
+      return Status(1, STATUS_LITERAL("Extension response out of order"));
+    }
+    std::move(received.begin(),
+              received.end(),
+              results + sent.begin + sent.received);
+    sent.received += received.size();
+    if (sent.received == sent.end - sent.begin) {
+      in_flight.pop_front();
+    }
+    return Status(0, "OK");
+  };
+
+  // Results start as success, a failure marks requests that were not sent.
+  for (size_t i = 0; i < count; i++) {
+    results[i].status = Status(0, "OK");
+  }
+
+  size_t next = 0;
+  while (next < count || !in_flight.empty()) {
+    if (ring.closed()) {
+      fail(in_flight.empty() ? next : in_flight.front().begin,
+           Status(1, STATUS_LITERAL("Extension channel is closed")));
+      return;
+    }
+
+    if (next == count || in_flight.size() == kMaxFramesInFlight) {
+      auto status = receive();
+      if (!status.ok()) {
+        fail(in_flight.front().begin, status);
+        return;
+      }
+      continue;
+    }
+
+    // Coalesce as many requests as fit one frame.
+    auto begin = next;
+    auto size = extensionRequestSize(registry_name, item_name, nullptr, 0);
+    while (next < count &&
+           size + fieldsSize(requests[next]) <= ring.maxFrame()) {
+      size += fieldsSize(requests[next]);
+      next++;
+    }
+    if (next == begin) {
+      results[next++].status = Status(
+          1,
+          STATUS_LITERAL("Extension request exceeds the channel frame size"));
+      continue;
+    }
+
+    // Only wait for space if no response could free it.
+    auto out = ring.reserve(
+        size, (in_flight.empty()) ? timeout_ : std::chrono::milliseconds(0));
+    if (out == nullptr) {
+      next = begin;
+      auto status =
+          (in_flight.empty())
+              ? Status(1,
+                       STATUS_LITERAL("Extension channel is closed or stalled"))
+              : receive();
+      if (!status.ok()) {
+        fail(in_flight.empty() ? begin : in_flight.front().begin, status);
+        return;
+      }
+      continue;
+    }
+
+    auto id = ++next_id_;
+    encodeExtensionRequest(
+        id, registry_name, item_name, requests + begin, next - begin, out);
+    ring.commit();
+    in_flight.push_back({id, begin, next, 0});
+  }
+}
+
+#endif
+}
@@ -0,0 +1,228 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include <registry.h>
+
+namespace osquery {
+
+/**
+ * @brief The extension call frame codec.
+ *
+ * Frames are fixed-width integers and length-prefixed bytes in host byte
+ * order, both ends share a host. A frame is sized before it is encoded, so
+ * it is written exactly once, in place, into its destination (a shared
+ * memory ring slot or a socket buffer).
+ */
+size_t extensionRequestSize(const std::string& registry_name,
+                            const std::string& item_name,
+                            const PluginRequest* requests,
+                            size_t count);
+
+/// Encode count requests to one item, a batch of one is a single call.
+void encodeExtensionRequest(uint64_t id,
+                            const std::string& registry_name,
+                            const std::string& item_name,
+                            const PluginRequest* requests,
+                            size_t count,
+                            char* out);
+
+Status decodeExtensionRequest(boost::string_ref frame,
+                              uint64_t& id,
+                              std::string& registry_name,
+                              std::string& item_name,
+                              std::vector<PluginRequest>& requests);
+
+size_t extensionResponseSize(const PluginCallResult* results, size_t count);
+
+/// Encode a result for each request of a batch, in request order.
+void encodeExtensionResponse(uint64_t id,
+                             const PluginCallResult* results,
+                             size_t count,
+                             char* out);
+
+/// Decode a response, appending its results.
+Status decodeExtensionResponse(boost::string_ref frame,
+                               uint64_t& id,
+                               std::vector<PluginCallResult>& results);
+
+#ifdef __linux__
+
+/**
+ * @brief A single-producer, single-consumer ring of frames in shared memory.
+ *
+ * The ring is an anonymous shared mapping, inherited by processes forked
+ * after it is created. A producer reserves a contiguous frame, writes its
+ * payload directly into the mapping, and commits it; the consumer reads the
+ * frame in place and releases it. Neither side copies a payload through an
+ * intermediate buffer or a syscall.
+ *
+ * Each side spins briefly before sleeping on an eventfd. The other side only
+ * writes the eventfd if a sleeper announced itself, so a busy ring makes no
+ * syscalls at all. A negative timeout waits until the ring is closed.
+ */
+class ShmRing : private boost::noncopyable {
+ public:
+  ~ShmRing();
+
+  /// Map a ring of at least capacity bytes, rounded up to a power of 2.
+  static Status create(size_t capacity, std::unique_ptr<ShmRing>& ring);
+
+  /// The largest frame payload, half of the capacity less a frame header.
+  size_t maxFrame() const;
+
+  /**
+   * @brief Reserve a contiguous frame, waiting for the consumer if full.
+   *
+   * @return The frame payload to write, or nullptr if size exceeds maxFrame,
+   * the ring was closed, or the timeout expired.
+   */
+  char* reserve(size_t size, std::chrono::milliseconds timeout);
+
+  /// Publish the reserved frame, waking the consumer if it sleeps.
+  void commit();
+
+  /**
+   * @brief Wait for the next frame and view it in place.
+   *
+   * @return false if the ring was closed or the timeout expired.
+   */
+  bool read(boost::string_ref& frame, std::chrono::milliseconds timeout);
+
+  /// Free the frame returned by read, waking the producer if it sleeps.
+  void release();
+
+  /// Fail current and later waits on both sides.
+  void close();
+
+  bool closed() const;
+
+ private:
+  struct Header;
+
+  ShmRing() = default;
+
+  /// Spin, then sleep on fd until ready or closed.
+  bool wait(std::atomic<uint32_t>& waiting,
+            int fd,
+            std::chrono::milliseconds timeout,
+            const std::function<bool()>& ready) const;
+
+  /// Wake a sleeper on fd if one announced itself.
+  static void wake(const std::atomic<uint32_t>& waiting, int fd);
+
+ private:
+  Header* header_{nullptr};
+  char* data_{nullptr};
+  size_t capacity_{0};
+  size_t mapping_size_{0};
+
+  /// Written by the producer when the ring has data, and the consumer space.
+  int data_fd_{-1};
+  int space_fd_{-1};
+
+  /// Producer and consumer positions past the reserved and read frames.
+  uint64_t reserved_{0};
+  size_t reserved_size_{0};
+  uint64_t read_end_{0};
+};
+
+/// A request ring and a response ring between osquery and one extension.
+struct ShmChannel {
+  std::unique_ptr<ShmRing> requests;
+  std::unique_ptr<ShmRing> responses;
+
+  static Status create(size_t capacity, std::shared_ptr<ShmChannel>& channel);
+
+  /// Close both rings, the other process sees its waits fail.
+  void close() {
+    requests->close();
+    responses->close();
+  }
+};
+
+using ShmChannelRef = std::shared_ptr<ShmChannel>;
+
+/// Serves one extension call, usually RegistryFactory::call.
+using ShmCallHandler = std::function<Status(const std::string& registry_name,
+                                            const std::string& item_name,
+                                            const PluginRequest& request,
+                                            PluginResponse& response)>;
+
+/**
+ * @brief The extension side: answer requests until the channel is closed.
+ *
+ * A batch's results are split over as many response frames as they need.
+ * A single result larger than a frame is replaced by a failed status.
+ */
+void serveShmChannel(ShmChannel& channel, const ShmCallHandler& handler);
+
+/**
+ * @brief The osquery side of a shared-memory extension channel.
+ *
+ * Concurrent callers serialize on the request ring, which has a single
+ * producer, and each waits for its own response. A call that does not
+ * complete within the timeout fails and closes the channel, since a late
+ * response would otherwise be read by the next caller.
+ *
+ * A batch is coalesced into as few frames as fit the ring, and several
+ * frames are kept in flight so the extension works on one while the next
+ * is written. Whenever the request ring is full a response is read, so
+ * neither side can block the other indefinitely.
+ */
+class ShmExtensionTransport : public ExtensionTransport {
+ public:
+  explicit ShmExtensionTransport(
+      ShmChannelRef channel,
+      std::chrono::milliseconds timeout = std::chrono::milliseconds(5000))
+      : channel_(std::move(channel)), timeout_(timeout) {}
+
+  Status call(const std::string& registry_name,
+              const std::string& item_name,
+              const PluginRequest& request,
+              PluginResponse& response) override;
+
+  void callBatch(const std::string& registry_name,
+                 const std::string& item_name,
+                 const std::vector<PluginRequest>& requests,
+                 std::vector<PluginCallResult>& results) override;
+
+ private:
+  /// Exchange count requests for their results, holding mutex_.
+  void exchange(const std::string& registry_name,
+                const std::string& item_name,
+                const PluginRequest* requests,
+                size_t count,
+                PluginCallResult* results);
+
+ private:
+  ShmChannelRef channel_;
+  std::chrono::milliseconds timeout_;
+
+  /// Held for a request and its response.
+  std::mutex mutex_;
+  uint64_t next_id_{0};
+};
+
+#endif
+}
@@ -10,11 +10,27 @@
 
 #pragma once
 
+#include <cstring>
+#include <ostream>
 #include <sstream>
 #include <string>
+#include <utility>
 
 namespace osquery {
 
+/**
+ * @brief A message with static storage that a Status references, not copies.
+ *
+ * Construct one with STATUS_LITERAL, which only accepts a string literal.
+ */
+struct StatusLiteral {
+  const char* data;
+  size_t size;
+};
+
+/// Wrap a string literal for a Status, any other argument fails to compile.
+#define STATUS_LITERAL(s) (::osquery::StatusLiteral{"" s, sizeof(s) - 1})
+
 /**
  * @brief A utility class which is used to express the state of operations.
  *
@@ -37,21 +53,59 @@ class Status {
    * Note that the default constructor initialized an osquery::Status instance
    * to a state such that a successful operation is indicated.
    */
-  explicit Status(int c = 0) : code_(c), message_("OK") {}
+  explicit Status(int c = 0) : code_(c), message_("OK"), message_size_(2) {}
 
   /**
-   * @brief A constructor which can be used to concisely express the status of
-   * an operation.
+   * @brief A constructor for a status with a static message.
+   *
+   * The message is referenced and not copied, so failure paths returning a
+   * fixed message do not allocate.
+   *
+   * @code{.cpp}
+   *   return Status(1, STATUS_LITERAL("Malformed broadcast delta"));
+   * @endcode
    *
    * @param c a status code. The idiom is that a zero status code indicates a
    * successful operation and a non-zero status code indicates a failed
    * operation.
    * @param m a message indicating some extra detail regarding the operation.
-   * If all operations were successful, this message should be "OK".
-   * Otherwise, it doesn't matter what the string is, as long as both the
-   * setter and caller agree.
    */
-  Status(int c, std::string m) : code_(c), message_(m) {}
+  Status(int c, StatusLiteral m)
+      : code_(c), message_(m.data), message_size_(m.size) {}
+
+  /**
+   * @brief A constructor which can be used to concisely express the status of
+   * an operation.
+   *
+   * @param c a status code, see above.
+   * @param m a message, copied. If all operations were successful, this
+   * message should be "OK". Otherwise, it doesn't matter what the string is,
+   * as long as both the setter and caller agree.
+   */
+  Status(int c, std::string m)
+      : code_(c), message_(nullptr), detail_(std::move(m)) {}
+
+  /**
+   * @brief A constructor for a message formatted on demand.
+   *
+   * The message is the literal prefix followed by the detail, but they are
+   * only joined if the message is read. Short details, such as most item
+   * names, fit the string's inline storage and are not allocated.
+   *
+   * @code{.cpp}
+   *   return Status(
+   *       1, STATUS_LITERAL("Cannot call registry item: "), item_name);
+   * @endcode
+   */
+  Status(int c, StatusLiteral prefix, std::string detail)
+      : code_(c),
+        message_(prefix.data),
+        message_size_(prefix.size),
+        detail_(std::move(detail)) {}
+
+  /// A prefix that is not a STATUS_LITERAL is joined with the detail now.
+  Status(int c, const std::string& prefix, const std::string& detail)
+      : Status(c, prefix + detail) {}
 
  public:
   /**
@@ -68,7 +122,31 @@ class Status {
    * success or failure of an operation. On successful operations, the idiom
    * is for the message to be "OK"
    */
-  std::string getMessage() const { return message_; }
+  std::string getMessage() const {
+    std::string message;
+    appendMessage(message);
+    return message;
+  }
+
+  /// The length of the message, without formatting it.
+  size_t getMessageSize() const { return message_size_ + detail_.size(); }
+
+  /// Append the message to a string, without an intermediate copy.
+  void appendMessage(std::string& out) const {
+    if (message_ != nullptr) {
+      out.append(message_, message_size_);
+    }
+    out.append(detail_);
+  }
+
+  /// Copy the message to a buffer of at least getMessageSize() bytes.
+  size_t copyMessage(char* out) const {
+    if (message_size_ > 0) {
+      std::memcpy(out, message_, message_size_);
+    }
+    std::memcpy(out + message_size_, detail_.data(), detail_.size());
+    return message_size_ + detail_.size();
+  }
 
   /**
    * @brief A convenience method to check if the return code is 0
@@ -111,20 +189,104 @@ class Status {
 
   // Enables use of gtest (ASSERT|EXPECT)_EQ
   bool operator==(const Status& rhs) const {
-    return (code_ == rhs.getCode()) && (message_ == rhs.getMessage());
+    if (code_ != rhs.code_) {
+      return false;
+    }
+    if (message_ == rhs.message_) {
+      return detail_ == rhs.detail_;
+    }
+    auto size = getMessageSize();
+    if (size != rhs.getMessageSize()) {
+      return false;
+    }
+    // Compare the messages piecewise, neither is formatted.
+    for (size_t i = 0; i < size; i++) {
+      if (at(i) != rhs.at(i)) {
+        return false;
+      }
+    }
+    return true;
   }
 
   // Enables use of gtest (ASSERT|EXPECT)_NE
   bool operator!=(const Status& rhs) const { return !operator==(rhs); }
 
   // Enables pretty-printing in gtest (ASSERT|EXPECT)_(EQ|NE)
-  friend ::std::ostream& operator<<(::std::ostream& os, const Status& s);
+  friend ::std::ostream& operator<<(::std::ostream& os, const Status& s) {
+    if (s.message_ != nullptr) {
+      os << s.message_;
+    }
+    return os << s.detail_;
+  }
+
+ private:
+  /// The message character at an offset, the prefix then the detail.
+  char at(size_t i) const {
+    return (i < message_size_) ? message_[i] : detail_[i - message_size_];
+  }
 
  private:
   /// the internal storage of the status code
   int code_;
 
-  /// the internal storage of the status message
-  std::string message_;
+  /// A static message, or its prefix, nullptr if the detail is the message.
+  const char* message_;
+
+  /// The length of the static message, 0 if there is none.
+  size_t message_size_{0};
+
+  /// A dynamic message, or what follows the static prefix.
+  std::string detail_;
+};
+
+/**
+ * @brief A value, or the Status explaining why there is none.
+ *
+ * Lookups that may miss return an Expected instead of throwing or filling an
+ * output parameter.
+ *
+ * @code{.cpp}
+ *   Expected<RegistryInterface*> findRegistry(const std::string& name) {
+ *     auto it = registries.find(name);
+ *     if (it == registries.end()) {
+ *       return Status(1, "Unknown registry: ", name);
+ *     }
+ *     return it->second;
+ *   }
+ * @endcode
+ *
+ * The value type must be default constructible, it is default constructed
+ * when there is no value.
+ */
+template <typename T>
+class Expected {
+ public:
+  /// An expected value, the status is OK.
+  Expected(T value) : value_(std::move(value)) {}
+
+  /// A failure, the status must not be OK.
+  Expected(Status status) : status_(std::move(status)) {}
+
+  /// Check if there is a value.
+  bool ok() const { return status_.ok(); }
+  explicit operator bool() const { return ok(); }
+
+  /// Why there is no value, or OK.
+  const Status& getStatus() const { return status_; }
+
+  /// Access the value, only meaningful if ok().
+  T& get() { return value_; }
+  const T& get() const { return value_; }
+  T& operator*() { return value_; }
+  const T& operator*() const { return value_; }
+  T* operator->() { return &value_; }
+  const T* operator->() const { return &value_; }
+
+  /// Move the value out.
+  T take() { return std::move(value_); }
+
+ private:
+  Status status_;
+  T value_{};
 };
 }
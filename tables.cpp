@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <plugin_stats.h>
+#include <tables.h>
+
+namespace osquery {
+
+/**
+ * @brief Table plugin registry.
+ *
+ * This creates an osquery registry for "table" which may implement
+ * TablePlugin. Tables are generated through RegistryFactory::callTable.
+ */
+CREATE_LAZY_REGISTRY(TablePlugin, "table");
+
+constexpr size_t TableRowWriter::kMaxReservedRows;
+
+bool TableRowWriter::write(Row row) {
+  if (!status_.ok()) {
+    return false;
+  }
+
+  batch_.push_back(std::move(row));
+  if (batch_.size() >= batch_size_) {
+    status_ = sink_(batch_);
+    batch_.clear();
+  }
+  return status_.ok();
+}
+
+Status TableRowWriter::finish() {
+  if (status_.ok() && !batch_.empty()) {
+    status_ = sink_(batch_);
+    batch_.clear();
+  }
+  return status_;
+}
+
+Status TablePlugin::call(const PluginRequest& request,
+                         PluginResponse& response) {
+  return Status(
+      1, STATUS_LITERAL("Table plugin action unknown: use callTable"));
+}
+
+Status TablePlugin::callRecord(const PluginRecord& request,
+                               PluginResponse& response) {
+  return Status(
+      1, STATUS_LITERAL("Table plugin action unknown: use callTable"));
+}
+
+/// Per registry item call counters, see PluginStats.
+class RegistryStatsTablePlugin : public TablePlugin {
+ public:
+  Status stream(QueryContext& context, TableRowWriter& writer) override {
+    for (const auto& stats : PluginStats::get().snapshot()) {
+      Row row;
+      row["registry"] = stats.registry;
+      row["item"] = stats.item;
+      row["calls"] = std::to_string(stats.calls);
+      row["errors"] = std::to_string(stats.errors);
+      row["request_bytes"] = std::to_string(stats.request_bytes);
+      row["response_bytes"] = std::to_string(stats.response_bytes);
+      row["p50_ns"] = std::to_string(stats.latencyPercentile(0.5));
+      row["p99_ns"] = std::to_string(stats.latencyPercentile(0.99));
+      if (!writer.write(std::move(row))) {
+        break;
+      }
+    }
+    return Status(0, "OK");
+  }
+};
+
+REGISTER(RegistryStatsTablePlugin, "table", "osquery_registry_stats");
+}
@@ -0,0 +1,96 @@
+/*
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+
+#include <registry.h>
+
+namespace osquery {
+
+/**
+ * @brief Bounded, batched output for table generation.
+ *
+ * A table plugin writes rows one at a time. Every batch_size rows the batch
+ * is handed to the sink, so the generator never holds more than one batch.
+ * The sink may apply backpressure by blocking, or stop the stream by
+ * returning a failed status.
+ */
+class TableRowWriter : private boost::noncopyable {
+ public:
+  using Sink = std::function<Status(QueryData& batch)>;
+
+  TableRowWriter(size_t batch_size, Sink sink)
+      : batch_size_((batch_size == 0) ? 1 : batch_size),
+        sink_(std::move(sink)) {
+    batch_.reserve(std::min(batch_size_, kMaxReservedRows));
+  }
+
+  /**
+   * @brief Add a row to the current batch.
+   *
+   * @return false if the consumer stopped the stream, generation should end.
+   */
+  bool write(Row row);
+
+  /// Hand any partial batch to the sink, called once generation ends.
+  Status finish();
+
+  /// The first failure returned by the sink, or success.
+  const Status& status() const {
+    return status_;
+  }
+
+ private:
+  /// Materializing callers use an unbounded batch, do not reserve for it.
+  static constexpr size_t kMaxReservedRows = 1024;
+
+  size_t batch_size_;
+  Sink sink_;
+  QueryData batch_;
+  Status status_;
+};
+
+/**
+ * @brief The table plugin type, items of the "table" registry.
+ *
+ * Tables may implement either generate, which materializes every row, or
+ * stream, which writes rows to a TableRowWriter as they are produced. Only
+ * streaming tables benefit from RegistryFactory::callTable's bounded memory.
+ */
+class TablePlugin : public Plugin {
+ public:
+  /// Generate the complete table.
+  virtual QueryData generate(QueryContext& context) {
+    return QueryData();
+  }
+
+  /**
+   * @brief Generate the table in batches.
+   *
+   * The default adapts generate. Implementations should stop as soon as
+   * TableRowWriter::write returns false.
+   */
+  virtual Status stream(QueryContext& context, TableRowWriter& writer) {
+    for (auto& row : generate(context)) {
+      if (!writer.write(std::move(row))) {
+        break;
+      }
+    }
+    return Status(0, "OK");
+  }
+
+  Status call(const PluginRequest& request, PluginResponse& response) override;
+  Status callRecord(const PluginRecord& request,
+                    PluginResponse& response) override;
+};
+}